@@ -0,0 +1,423 @@
+#include <string.h>
+
+#include "backend.h"
+#include "lazy.h"
+#include "list_sort.h"
+#include "queue.h"
+#include "ringq.h"
+
+void q_shuffle(struct list_head *head);
+
+int compare_element_t(void *priv,
+                      const struct list_head *l,
+                      const struct list_head *r);
+
+/* Linked list of element_t, implemented by queue.c */
+
+static void *list_new(void)
+{
+    return q_new();
+}
+
+static void list_free(void *q)
+{
+    q_free(q);
+}
+
+static bool list_insert_head(void *q, char *s)
+{
+    return q_insert_head(q, s);
+}
+
+static bool list_insert_tail(void *q, char *s)
+{
+    return q_insert_tail(q, s);
+}
+
+static bool list_remove(element_t *e)
+{
+    if (!e)
+        return false;
+    // q_remove_head and q_remove_tail are not responsible for releasing node
+    q_release_element(e);
+    return true;
+}
+
+static bool list_remove_head(void *q, char *sp, size_t bufsize)
+{
+    return list_remove(q_remove_head(q, sp, bufsize));
+}
+
+static bool list_remove_tail(void *q, char *sp, size_t bufsize)
+{
+    return list_remove(q_remove_tail(q, sp, bufsize));
+}
+
+/* The list is walked as is, so the ends are swapped if reversal is pending */
+static char *list_peek_head(void *q)
+{
+    struct list_head *head = q;
+    struct list_head *node = q_reversed(head) ? head->prev : head->next;
+    return list_entry(node, element_t, list)->value;
+}
+
+static char *list_peek_tail(void *q)
+{
+    struct list_head *head = q;
+    struct list_head *node = q_reversed(head) ? head->next : head->prev;
+    return list_entry(node, element_t, list)->value;
+}
+
+static int list_size(void *q)
+{
+    return q_size(q);
+}
+
+static bool list_delete_mid(void *q)
+{
+    return q_delete_mid(q);
+}
+
+static bool list_delete_dup(void *q)
+{
+    return q_delete_dup(q);
+}
+
+static void list_swap(void *q)
+{
+    q_swap(q);
+}
+
+static void list_reverse(void *q)
+{
+    q_reverse(q);
+}
+
+/* Sort with the Linux kernel list_sort, q_sort is used by 'sort linux' */
+static bool list_sort_queue(void *q)
+{
+    q_set_reversed(q, false);
+    list_sort(NULL, q, compare_element_t);
+    return true;
+}
+
+static bool list_shuffle(void *q)
+{
+    q_shuffle(q);
+    return true;
+}
+
+/* Links are followed both ways, as a broken queue may lack either */
+static bool list_check(void *q)
+{
+    struct list_head *head = q;
+    struct list_head *cur = head->next;
+    while (cur != head) {
+        if (!cur)
+            return false;
+        cur = cur->next;
+    }
+
+    cur = head->prev;
+    while (cur != head) {
+        if (!cur)
+            return false;
+        cur = cur->prev;
+    }
+
+    return true;
+}
+
+/* Walk from the logical head, against the links if reversal is pending */
+static void list_iter_init(void *q, backend_iter_t *it)
+{
+    struct list_head *head = q;
+    it->backward = q_reversed(head);
+    it->cur = it->backward ? head->prev : head->next;
+}
+
+static char *list_iter_next(void *q, backend_iter_t *it)
+{
+    if (it->cur == q)
+        return NULL;
+    char *value = list_entry(it->cur, element_t, list)->value;
+    it->cur = it->backward ? it->cur->prev : it->cur->next;
+    return value;
+}
+
+const queue_ops_t list_ops = {
+    .new = list_new,
+    .free = list_free,
+    .insert_head = list_insert_head,
+    .insert_tail = list_insert_tail,
+    .remove_head = list_remove_head,
+    .remove_tail = list_remove_tail,
+    .peek_head = list_peek_head,
+    .peek_tail = list_peek_tail,
+    .size = list_size,
+    .delete_mid = list_delete_mid,
+    .delete_dup = list_delete_dup,
+    .swap = list_swap,
+    .reverse = list_reverse,
+    .sort = list_sort_queue,
+    .shuffle = list_shuffle,
+    .check = list_check,
+    .iter_init = list_iter_init,
+    .iter_next = list_iter_next,
+};
+
+/* Unrolled list of chunks */
+
+static void *unrolled_new(void)
+{
+    return uq_new();
+}
+
+static void unrolled_free(void *q)
+{
+    uq_free(q);
+}
+
+static bool unrolled_insert_head(void *q, char *s)
+{
+    return uq_insert_head(q, s);
+}
+
+static bool unrolled_insert_tail(void *q, char *s)
+{
+    return uq_insert_tail(q, s);
+}
+
+static bool unrolled_remove(char *s)
+{
+    if (!s)
+        return false;
+    uq_release(s);
+    return true;
+}
+
+static bool unrolled_remove_head(void *q, char *sp, size_t bufsize)
+{
+    return unrolled_remove(uq_remove_head(q, sp, bufsize));
+}
+
+static bool unrolled_remove_tail(void *q, char *sp, size_t bufsize)
+{
+    return unrolled_remove(uq_remove_tail(q, sp, bufsize));
+}
+
+static char *unrolled_peek_head(void *q)
+{
+    return uq_peek_head(q);
+}
+
+static char *unrolled_peek_tail(void *q)
+{
+    return uq_peek_tail(q);
+}
+
+static int unrolled_size(void *q)
+{
+    return uq_size(q);
+}
+
+static bool unrolled_delete_mid(void *q)
+{
+    return uq_delete_mid(q);
+}
+
+static bool unrolled_delete_dup(void *q)
+{
+    return uq_delete_dup(q);
+}
+
+static void unrolled_swap(void *q)
+{
+    uq_swap(q);
+}
+
+static void unrolled_reverse(void *q)
+{
+    uq_reverse(q);
+}
+
+static bool unrolled_sort(void *q)
+{
+    return uq_sort(q);
+}
+
+static bool unrolled_shuffle(void *q)
+{
+    return uq_shuffle(q);
+}
+
+static void unrolled_iter_init(void *q, backend_iter_t *it)
+{
+    uq_iter_init(q, &it->uq);
+}
+
+static char *unrolled_iter_next(void *q, backend_iter_t *it)
+{
+    (void) q;
+    return uq_iter_next(&it->uq);
+}
+
+const queue_ops_t unrolled_ops = {
+    .new = unrolled_new,
+    .free = unrolled_free,
+    .insert_head = unrolled_insert_head,
+    .insert_tail = unrolled_insert_tail,
+    .remove_head = unrolled_remove_head,
+    .remove_tail = unrolled_remove_tail,
+    .peek_head = unrolled_peek_head,
+    .peek_tail = unrolled_peek_tail,
+    .size = unrolled_size,
+    .delete_mid = unrolled_delete_mid,
+    .delete_dup = unrolled_delete_dup,
+    .swap = unrolled_swap,
+    .reverse = unrolled_reverse,
+    .sort = unrolled_sort,
+    .shuffle = unrolled_shuffle,
+    .iter_init = unrolled_iter_init,
+    .iter_next = unrolled_iter_next,
+    .sort_allocates = true,
+};
+
+/* Ring buffer */
+
+static void *ring_new(void)
+{
+    return rq_new();
+}
+
+static void ring_free(void *q)
+{
+    rq_free(q);
+}
+
+static bool ring_insert_head(void *q, char *s)
+{
+    return rq_insert_head(q, s);
+}
+
+static bool ring_insert_tail(void *q, char *s)
+{
+    return rq_insert_tail(q, s);
+}
+
+static bool ring_remove(char *s)
+{
+    if (!s)
+        return false;
+    rq_release(s);
+    return true;
+}
+
+static bool ring_remove_head(void *q, char *sp, size_t bufsize)
+{
+    return ring_remove(rq_remove_head(q, sp, bufsize));
+}
+
+static bool ring_remove_tail(void *q, char *sp, size_t bufsize)
+{
+    return ring_remove(rq_remove_tail(q, sp, bufsize));
+}
+
+static char *ring_peek_head(void *q)
+{
+    return rq_at(q, 0);
+}
+
+static char *ring_peek_tail(void *q)
+{
+    return rq_at(q, rq_size(q) - 1);
+}
+
+static int ring_size(void *q)
+{
+    return rq_size(q);
+}
+
+static bool ring_delete_mid(void *q)
+{
+    return rq_delete_mid(q);
+}
+
+static bool ring_delete_dup(void *q)
+{
+    return rq_delete_dup(q);
+}
+
+static void ring_swap(void *q)
+{
+    rq_swap(q);
+}
+
+static void ring_reverse(void *q)
+{
+    rq_reverse(q);
+}
+
+static bool ring_sort(void *q)
+{
+    rq_sort(q);
+    return true;
+}
+
+static bool ring_shuffle(void *q)
+{
+    rq_shuffle(q);
+    return true;
+}
+
+static void ring_iter_init(void *q, backend_iter_t *it)
+{
+    (void) q;
+    it->i = 0;
+}
+
+static char *ring_iter_next(void *q, backend_iter_t *it)
+{
+    return rq_at(q, it->i++);
+}
+
+const queue_ops_t ring_ops = {
+    .new = ring_new,
+    .free = ring_free,
+    .insert_head = ring_insert_head,
+    .insert_tail = ring_insert_tail,
+    .remove_head = ring_remove_head,
+    .remove_tail = ring_remove_tail,
+    .peek_head = ring_peek_head,
+    .peek_tail = ring_peek_tail,
+    .size = ring_size,
+    .delete_mid = ring_delete_mid,
+    .delete_dup = ring_delete_dup,
+    .swap = ring_swap,
+    .reverse = ring_reverse,
+    .sort = ring_sort,
+    .shuffle = ring_shuffle,
+    .iter_init = ring_iter_init,
+    .iter_next = ring_iter_next,
+};
+
+/* Registry, backends[i] being called backend_names[i] */
+static const queue_ops_t *const backends[] = {&list_ops, &unrolled_ops,
+                                              &ring_ops};
+
+const char *const backend_names[] = {"list", "unrolled", "ring", NULL};
+
+const queue_ops_t *backend_get(int index)
+{
+    if (index < 0 || index >= (int) (sizeof(backends) / sizeof(backends[0])))
+        return NULL;
+    return backends[index];
+}
+
+int backend_find(const char *name)
+{
+    for (int i = 0; backend_names[i]; i++)
+        if (!strcmp(backend_names[i], name))
+            return i;
+    return -1;
+}
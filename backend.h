@@ -0,0 +1,73 @@
+#ifndef LAB0_BACKEND_H
+#define LAB0_BACKEND_H
+
+/*
+ * Interchangeable implementations of the queue.
+ *
+ * Each backend provides the queue operations through a table, and qtest
+ * drives the queue under test only through the table of the backend that
+ * created it.  All backends thus run the same traces in one binary.  Queues
+ * are opaque to the caller.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "list.h"
+#include "unrolled.h"
+
+/* Position of a traversal, used by the backend that started it */
+typedef struct {
+    struct list_head *cur;
+    uq_iter_t uq;
+    size_t i;
+    bool backward; /* Follow prev links, for a list with reversal pending */
+} backend_iter_t;
+
+typedef struct {
+    /* Create empty queue.  Return NULL if could not allocate space */
+    void *(*new)(void);
+    void (*free)(void *q);
+    bool (*insert_head)(void *q, char *s);
+    bool (*insert_tail)(void *q, char *s);
+    /*
+     * Remove string, copying it to sp as q_remove_head does, and release
+     * it.  Return false if queue is NULL or empty.
+     */
+    bool (*remove_head)(void *q, char *sp, size_t bufsize);
+    bool (*remove_tail)(void *q, char *sp, size_t bufsize);
+    /* Return string stored at head or tail of non-empty queue */
+    char *(*peek_head)(void *q);
+    char *(*peek_tail)(void *q);
+    int (*size)(void *q);
+    bool (*delete_mid)(void *q);
+    bool (*delete_dup)(void *q);
+    void (*swap)(void *q);
+    void (*reverse)(void *q);
+    /* Return false if scratch space could not be allocated */
+    bool (*sort)(void *q);
+    bool (*shuffle)(void *q);
+    /*
+     * Verify structure of queue and bring it into a state fit for
+     * traversal.  NULL if there is nothing to verify.
+     */
+    bool (*check)(void *q);
+    void (*iter_init)(void *q, backend_iter_t *it);
+    /* Return next string of traversal, NULL at the end */
+    char *(*iter_next)(void *q, backend_iter_t *it);
+    /* Sort allocates, so it cannot run in noallocate mode */
+    bool sort_allocates;
+} queue_ops_t;
+
+/* Linked list of queue.c, and the queues of unrolled.c and ringq.c */
+extern const queue_ops_t list_ops, unrolled_ops, ring_ops;
+
+/* Names of registered backends, NULL terminated */
+extern const char *const backend_names[];
+
+/* Return backend registered as backend_names[index], NULL if none */
+const queue_ops_t *backend_get(int index);
+
+/* Return index of backend called name, -1 if none */
+int backend_find(const char *name);
+
+#endif /* LAB0_BACKEND_H */
@@ -0,0 +1,619 @@
+/* Benchmark suite for queue operations with a stored-baseline regression gate
+ *
+ * The suite runs in several independent child processes.  Each of them times
+ * every operation several times on a freshly built queue and keeps the
+ * median, so that a sample reflects run-to-run variance rather than the
+ * noise within one process.  The per-process medians (in nanoseconds) are
+ * written as JSON so that a later run can be compared against them.  In
+ * compare mode, Welch's t-test of dudect decides whether an operation got
+ * slower, and the run fails only when it did and its median also slowed
+ * down by more than the configured threshold.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dudect/ttest.h"
+#include "list.h"
+#include "list_sort.h"
+
+/* Our program needs to use regular malloc/free */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "queue.h"
+
+int compare_element_t(void *priv,
+                      const struct list_head *l,
+                      const struct list_head *r);
+
+/* Default number of elements in the benchmarked queue */
+#define BENCH_SIZE 100000
+
+/* Default number of timed calls per operation and process */
+#define BENCH_RUNS 7
+
+/* Default number of independent processes running the suite */
+#define BENCH_PROCS 5
+
+/* Maximum number of processes, hence of samples kept per operation */
+#define MAX_PROCS 32
+
+/* Maximum number of operations read from a baseline */
+#define MAX_OPS 32
+
+/* Default slowdown, in percent, tolerated before failing the gate */
+#define BENCH_THRESHOLD 10
+
+/*
+ * Welch's t above which a slowdown is significant, a one-sided p of about
+ * 0.01 for the default number of processes
+ */
+#define T_SIGNIFICANT 3.0
+
+#define MIN_RANDSTR_LEN 5
+#define MAX_RANDSTR_LEN 10
+static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
+
+static int bench_size = BENCH_SIZE;
+static int bench_runs = BENCH_RUNS;
+static int bench_procs = BENCH_PROCS;
+
+typedef void (*bench_function)(struct list_head *head);
+
+static void do_list_sort(struct list_head *head)
+{
+    list_sort(NULL, head, compare_element_t);
+}
+
+static void do_q_sort(struct list_head *head)
+{
+    q_sort(head);
+}
+
+static void do_reverse(struct list_head *head)
+{
+    q_reverse(head);
+}
+
+static void do_size(struct list_head *head)
+{
+    q_size(head);
+}
+
+static void do_delete_mid(struct list_head *head)
+{
+    q_delete_mid(head);
+}
+
+/* Operations of the suite */
+static const struct {
+    char *name;
+    bench_function operation;
+} bench_ops[] = {
+    {"sort", do_list_sort},
+    {"q_sort", do_q_sort},
+    {"reverse", do_reverse},
+    {"size", do_size},
+    {"delete_mid", do_delete_mid},
+};
+
+#define N_OPS (sizeof(bench_ops) / sizeof(bench_ops[0]))
+
+/* Samples of one operation, either measured or loaded from a baseline */
+typedef struct {
+    char name[32];
+    int cnt;
+    double ns[MAX_PROCS];
+} samples_t;
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Median of n values, which are left in place.  Return 0 if out of memory */
+static double median(const double *v, int n)
+{
+    double *copy = malloc(n * sizeof(double));
+    if (!copy)
+        return 0;
+
+    memcpy(copy, v, n * sizeof(double));
+    qsort(copy, n, sizeof(double), compare_double);
+    double m = n % 2 ? copy[n / 2] : (copy[n / 2 - 1] + copy[n / 2]) / 2;
+    free(copy);
+    return m;
+}
+
+static void fill_rand_string(char *buf, size_t buf_size)
+{
+    size_t len = 0;
+    while (len < MIN_RANDSTR_LEN)
+        len = rand() % buf_size;
+
+    for (size_t n = 0; n < len; n++)
+        buf[n] = charset[rand() % (sizeof charset - 1)];
+    buf[len] = '\0';
+}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static struct list_head *build_queue(int size)
+{
+    char buf[MAX_RANDSTR_LEN];
+    struct list_head *head = q_new();
+    if (!head)
+        return NULL;
+
+    for (int i = 0; i < size; i++) {
+        fill_rand_string(buf, sizeof(buf));
+        if (!q_insert_tail(head, buf)) {
+            q_free(head);
+            return NULL;
+        }
+    }
+    return head;
+}
+
+/* Time every operation of the suite bench_runs times, keeping the medians */
+static bool run_suite(double *medians)
+{
+    double *ns = malloc(bench_runs * sizeof(double));
+    if (!ns)
+        return false;
+
+    /* Freeing big queues in cautious mode is quadratic */
+    set_cautious_mode(false);
+
+    for (size_t op = 0; op < N_OPS; op++) {
+        /* The first round warms up caches and the allocator */
+        for (int r = -1; r < bench_runs; r++) {
+            struct list_head *head = build_queue(bench_size);
+            if (!head) {
+                fprintf(stderr, "Could not allocate queue of %d elements\n",
+                        bench_size);
+                free(ns);
+                return false;
+            }
+
+            double start = now_ns();
+            bench_ops[op].operation(head);
+            double elapsed = now_ns() - start;
+            q_free(head);
+
+            if (r >= 0)
+                ns[r] = elapsed;
+        }
+        medians[op] = median(ns, bench_runs);
+    }
+
+    set_cautious_mode(true);
+    free(ns);
+    return true;
+}
+
+/* Print medians of suite run in this process, one "name ns" per line */
+static bool print_suite()
+{
+    double medians[N_OPS];
+    if (!run_suite(medians))
+        return false;
+    for (size_t op = 0; op < N_OPS; op++)
+        printf("%s %.0f\n", bench_ops[op].name, medians[op]);
+    return true;
+}
+
+/*
+ * Run the suite once in a child process and add its medians to samples,
+ * which hold the operations of bench_ops.
+ */
+static bool run_proc(samples_t *samples)
+{
+    int fds[2];
+    if (pipe(fds)) {
+        perror("pipe");
+        return false;
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        /* Every process draws its own queues */
+        srand((unsigned int) (time(NULL) ^ getpid()));
+        bool ok = print_suite();
+        fflush(stdout);
+        _exit(ok ? 0 : 1);
+    }
+
+    close(fds[1]);
+    FILE *fp = fdopen(fds[0], "r");
+    char name[32];
+    double ns;
+    while (fp && fscanf(fp, "%31s %lf", name, &ns) == 2)
+        for (size_t op = 0; op < N_OPS; op++)
+            if (!strcmp(name, samples[op].name) && samples[op].cnt < MAX_PROCS)
+                samples[op].ns[samples[op].cnt++] = ns;
+    if (fp)
+        fclose(fp);
+    else
+        close(fds[0]);
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status)) {
+        fprintf(stderr, "Benchmark process failed\n");
+        return false;
+    }
+    return true;
+}
+
+static void init_samples(samples_t *samples)
+{
+    for (size_t op = 0; op < N_OPS; op++) {
+        strncpy(samples[op].name, bench_ops[op].name,
+                sizeof(samples[op].name) - 1);
+        samples[op].cnt = 0;
+    }
+}
+
+/* Run the suite in bench_procs processes, one after the other */
+static bool run_procs(samples_t *cur)
+{
+    init_samples(cur);
+    for (int p = 0; p < bench_procs; p++)
+        if (!run_proc(cur))
+            return false;
+    return true;
+}
+
+static bool save_samples(char *file_name, samples_t *samples, int n)
+{
+    FILE *fp = fopen(file_name, "w");
+    if (!fp) {
+        fprintf(stderr, "Could not open '%s': %s\n", file_name,
+                strerror(errno));
+        return false;
+    }
+
+    fprintf(fp,
+            "{\n  \"size\": %d,\n  \"runs\": %d,\n  \"procs\": %d,\n"
+            "  \"ops\": {",
+            bench_size, bench_runs, bench_procs);
+    for (int op = 0; op < n; op++) {
+        fprintf(fp, "%s\n    \"%s\": [", op ? "," : "", samples[op].name);
+        for (int i = 0; i < samples[op].cnt; i++)
+            fprintf(fp, "%s%.0f", i ? ", " : "", samples[op].ns[i]);
+        fprintf(fp, "]");
+    }
+    fprintf(fp, "\n  }\n}\n");
+    fclose(fp);
+    return true;
+}
+
+/*
+ * Minimal reader for the JSON emitted by save_samples.  Only objects,
+ * arrays, strings and numbers are recognized.
+ */
+typedef struct {
+    char *pos;
+} json_t;
+
+static void json_skip(json_t *js)
+{
+    while (*js->pos && (isspace(*js->pos) || *js->pos == ',' ||
+                        *js->pos == ':'))
+        js->pos++;
+}
+
+static bool json_string(json_t *js, char *dst, size_t size)
+{
+    json_skip(js);
+    if (*js->pos != '"')
+        return false;
+
+    char *end = strchr(++js->pos, '"');
+    if (!end)
+        return false;
+
+    size_t len = end - js->pos;
+    if (len >= size)
+        len = size - 1;
+    memcpy(dst, js->pos, len);
+    dst[len] = '\0';
+    js->pos = end + 1;
+    return true;
+}
+
+static bool json_expect(json_t *js, char c)
+{
+    json_skip(js);
+    if (*js->pos != c)
+        return false;
+    js->pos++;
+    return true;
+}
+
+static bool json_number(json_t *js, double *val)
+{
+    json_skip(js);
+    char *end;
+    *val = strtod(js->pos, &end);
+    if (end == js->pos)
+        return false;
+    js->pos = end;
+    return true;
+}
+
+/* Skip a number, string, array or object */
+static bool json_value(json_t *js)
+{
+    char key[64];
+    double val;
+
+    json_skip(js);
+    switch (*js->pos) {
+    case '"':
+        return json_string(js, key, sizeof(key));
+    case '[':
+    case '{': {
+        char close = *js->pos == '[' ? ']' : '}';
+        js->pos++;
+        while (!json_expect(js, close)) {
+            if (close == '}' && !json_string(js, key, sizeof(key)))
+                return false;
+            if (!json_value(js))
+                return false;
+        }
+        return true;
+    }
+    default:
+        return json_number(js, &val);
+    }
+}
+
+static int load_samples(char *file_name, samples_t *samples, int max)
+{
+    FILE *fp = fopen(file_name, "r");
+    if (!fp) {
+        fprintf(stderr, "Could not open baseline '%s': %s\n", file_name,
+                strerror(errno));
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    rewind(fp);
+    char *text = malloc(len + 1);
+    if (!text || fread(text, 1, len, fp) != (size_t) len) {
+        fprintf(stderr, "Could not read baseline '%s'\n", file_name);
+        free(text);
+        fclose(fp);
+        return -1;
+    }
+    text[len] = '\0';
+    fclose(fp);
+
+    int n = 0;
+    char key[64];
+    json_t js = {.pos = text};
+    if (!json_expect(&js, '{'))
+        goto bad;
+    while (!json_expect(&js, '}')) {
+        if (!json_string(&js, key, sizeof(key)))
+            goto bad;
+        if (strcmp(key, "ops")) {
+            if (!json_value(&js))
+                goto bad;
+            continue;
+        }
+
+        if (!json_expect(&js, '{'))
+            goto bad;
+        while (!json_expect(&js, '}')) {
+            if (n == max) {
+                /* Ignore operations beyond capacity */
+                if (!json_string(&js, key, sizeof(key)) || !json_value(&js))
+                    goto bad;
+                continue;
+            }
+
+            samples_t *s = &samples[n];
+            if (!json_string(&js, s->name, sizeof(s->name)) ||
+                !json_expect(&js, '['))
+                goto bad;
+            s->cnt = 0;
+            while (!json_expect(&js, ']')) {
+                double val;
+                if (!json_number(&js, &val))
+                    goto bad;
+                if (s->cnt < MAX_PROCS)
+                    s->ns[s->cnt++] = val;
+            }
+            n++;
+        }
+    }
+
+    free(text);
+    return n;
+
+bad:
+    fprintf(stderr, "Malformed baseline '%s'\n", file_name);
+    free(text);
+    return -1;
+}
+
+/* Welch's t of the slowdown of y against x, positive if y got slower */
+static double welch_t(const double *x, int m, const double *y, int n)
+{
+    t_ctx ctx;
+    t_init(&ctx);
+    for (int i = 0; i < m; i++)
+        t_push(&ctx, x[i], 0);
+    for (int i = 0; i < n; i++)
+        t_push(&ctx, y[i], 1);
+    return -t_compute(&ctx);
+}
+
+/* Compare current samples against the baseline; return number of regressions
+ */
+static int compare_samples(samples_t *base,
+                           int nbase,
+                           samples_t *cur,
+                           int ncur,
+                           int threshold)
+{
+    int regressions = 0;
+
+    printf("%-12s %12s %12s %8s %8s  %s\n", "op", "base(us)", "cur(us)",
+           "delta", "t", "verdict");
+    for (int i = 0; i < ncur; i++) {
+        samples_t *b = NULL;
+        for (int j = 0; j < nbase && !b; j++)
+            if (!strcmp(base[j].name, cur[i].name))
+                b = &base[j];
+        if (!b || b->cnt < 2 || cur[i].cnt < 2) {
+            printf("%-12s %12s %12s %8s %8s  %s\n", cur[i].name, "-", "-",
+                   "-", "-", "no baseline");
+            continue;
+        }
+
+        double base_ns = median(b->ns, b->cnt);
+        double cur_ns = median(cur[i].ns, cur[i].cnt);
+        double delta = 100.0 * (cur_ns - base_ns) / base_ns;
+        double t = welch_t(b->ns, b->cnt, cur[i].ns, cur[i].cnt);
+        bool regressed = delta > threshold && t > T_SIGNIFICANT;
+        if (regressed)
+            regressions++;
+
+        printf("%-12s %12.1f %12.1f %+7.1f%% %8.2f  %s\n", cur[i].name,
+               base_ns / 1e3, cur_ns / 1e3, delta, t,
+               regressed ? "REGRESSION" : "ok");
+    }
+
+    return regressions;
+}
+
+static void usage(char *cmd)
+{
+    printf(
+        "Usage: %s [-h] [-n SIZE] [-r RUNS] [-p PROCS] [-o OFILE] [-c BFILE] "
+        "[-t PCT]\n",
+        cmd);
+    printf("\t-h         Print this information\n");
+    printf("\t-n SIZE    Number of elements in queue (default: %d)\n",
+           BENCH_SIZE);
+    printf("\t-r RUNS    Timed calls per operation and process (default: %d)\n",
+           BENCH_RUNS);
+    printf("\t-p PROCS   Independent processes running the suite "
+           "(default: %d)\n",
+           BENCH_PROCS);
+    printf("\t-o OFILE   Write samples as JSON to OFILE\n");
+    printf("\t-c BFILE   Compare against baseline samples in BFILE\n");
+    printf("\t-t PCT     Tolerated slowdown in percent (default: %d)\n",
+           BENCH_THRESHOLD);
+    exit(0);
+}
+
+static int get_arg(char *arg, int min, int max)
+{
+    char *endptr;
+    errno = 0;
+    long val = strtol(arg, &endptr, 10);
+    if (errno != 0 || endptr == arg || *endptr != '\0' || val < min ||
+        val > max) {
+        fprintf(stderr, "Invalid argument '%s'\n", arg);
+        exit(EXIT_FAILURE);
+    }
+    return (int) val;
+}
+
+int main(int argc, char *argv[])
+{
+    char *outfile_name = NULL;
+    char *basefile_name = NULL;
+    int threshold = BENCH_THRESHOLD;
+    int c;
+
+    while ((c = getopt(argc, argv, "hn:r:p:o:c:t:")) != -1) {
+        switch (c) {
+        case 'h':
+            usage(argv[0]);
+            break;
+        case 'n':
+            bench_size = get_arg(optarg, 1, 100000000);
+            break;
+        case 'r':
+            bench_runs = get_arg(optarg, 1, 1000);
+            break;
+        case 'p':
+            bench_procs = get_arg(optarg, 2, MAX_PROCS);
+            break;
+        case 'o':
+            outfile_name = optarg;
+            break;
+        case 'c':
+            basefile_name = optarg;
+            break;
+        case 't':
+            threshold = get_arg(optarg, 0, 10000);
+            break;
+        default:
+            usage(argv[0]);
+            break;
+        }
+    }
+
+    static samples_t cur[N_OPS], base[MAX_OPS];
+    if (!run_procs(cur))
+        return 1;
+
+    if (outfile_name && !save_samples(outfile_name, cur, N_OPS))
+        return 1;
+
+    if (!basefile_name) {
+        for (size_t op = 0; op < N_OPS; op++) {
+            samples_t *s = &cur[op];
+            qsort(s->ns, s->cnt, sizeof(double), compare_double);
+            printf("%-12s %12.1f us  (%.1f-%.1f us over %d processes)\n",
+                   s->name, median(s->ns, s->cnt) / 1e3, s->ns[0] / 1e3,
+                   s->ns[s->cnt - 1] / 1e3, s->cnt);
+        }
+        return 0;
+    }
+
+    int nbase = load_samples(basefile_name, base, MAX_OPS);
+    if (nbase < 0)
+        return 1;
+
+    int regressions = compare_samples(base, nbase, cur, N_OPS, threshold);
+    if (regressions) {
+        printf("%d operation(s) regressed by more than %d%%\n", regressions,
+               threshold);
+        return 1;
+    }
+    return 0;
+}
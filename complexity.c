@@ -0,0 +1,103 @@
+#include "complexity.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const struct {
+    char *name;
+    char *abbrev;
+} models[O_COUNT] = {
+    [O_1] = {"O(1)", "1"},
+    [O_LOGN] = {"O(log n)", "logn"},
+    [O_N] = {"O(n)", "n"},
+    [O_NLOGN] = {"O(n log n)", "nlogn"},
+    [O_N2] = {"O(n^2)", "n2"},
+};
+
+static double growth(complexity_t order, double n)
+{
+    switch (order) {
+    case O_1:
+        return 1.0;
+    case O_LOGN:
+        return log2(n);
+    case O_N:
+        return n;
+    case O_NLOGN:
+        return n * log2(n);
+    case O_N2:
+    default:
+        return n * n;
+    }
+}
+
+const char *complexity_name(complexity_t order)
+{
+    return order < O_COUNT ? models[order].name : "unknown";
+}
+
+complexity_t complexity_parse(const char *name)
+{
+    for (int i = 0; i < O_COUNT; i++)
+        if (!strcmp(name, models[i].abbrev))
+            return i;
+    return O_COUNT;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Median slope of log v against log n between neighbouring samples */
+static double median_slope(const double *n, const double *v, int cnt)
+{
+    double slopes[COMPLEXITY_MAX_SAMPLES];
+    for (int i = 0; i + 1 < cnt; i++)
+        slopes[i] = log(v[i + 1] / v[i]) / log(n[i + 1] / n[i]);
+    qsort(slopes, cnt - 1, sizeof(double), compare_double);
+    int mid = (cnt - 1) / 2;
+    return cnt % 2 ? (slopes[mid - 1] + slopes[mid]) / 2 : slopes[mid];
+}
+
+bool complexity_fit(const double *n,
+                    const double *t,
+                    int cnt,
+                    complexity_fit_t *fit)
+{
+    if (cnt < 2 || cnt > COMPLEXITY_MAX_SAMPLES)
+        return false;
+
+    for (int i = 0; i < cnt; i++)
+        if (t[i] <= 0.0 || n[i] <= 1.0 || (i && n[i] <= n[i - 1]))
+            return false;
+
+    fit->slope = median_slope(n, t, cnt);
+    fit->order = O_1;
+    double dist[O_COUNT];
+    for (int m = 0; m < O_COUNT; m++) {
+        double f[COMPLEXITY_MAX_SAMPLES];
+        for (int i = 0; i < cnt; i++)
+            f[i] = growth(m, n[i]);
+        fit->model_slope[m] = median_slope(n, f, cnt);
+        /*
+         * Cache and TLB misses only ever add to the times as the data
+         * grows, so being above a model counts a quarter as much as below.
+         */
+        double d = fit->slope - fit->model_slope[m];
+        dist[m] = d > 0.0 ? d / 4 : -d;
+        if (dist[m] < dist[fit->order])
+            fit->order = m;
+    }
+
+    /* Compare the winner with the closest of the other models */
+    double second = INFINITY;
+    for (int m = 0; m < O_COUNT; m++)
+        if (m != fit->order && dist[m] < second)
+            second = dist[m];
+    fit->confidence = second > 0.0 ? 1.0 - dist[fit->order] / second : 0.0;
+
+    return true;
+}
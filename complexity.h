@@ -0,0 +1,60 @@
+#ifndef LAB0_COMPLEXITY_H
+#define LAB0_COMPLEXITY_H
+
+/*
+ * Empirical estimation of asymptotic complexity.
+ *
+ * Execution times sampled over increasing problem sizes are compared with
+ * a fixed set of growth models by their slope on a log-log scale.  The
+ * slopes between neighbouring sizes are taken, and the model whose median
+ * slope over the same sizes is closest to that of the times wins, with a
+ * slope above that of a model counting as a quarter as far.  Unlike a least
+ * squares fit, the median is not swayed by the jump in times when the data
+ * outgrows a cache, nor by the fixed cost of a call.
+ */
+
+#include <stdbool.h>
+
+/* Maximum number of samples given to complexity_fit */
+#define COMPLEXITY_MAX_SAMPLES 32
+
+/* Growth models, in increasing order */
+typedef enum {
+    O_1,
+    O_LOGN,
+    O_N,
+    O_NLOGN,
+    O_N2,
+    O_COUNT,
+} complexity_t;
+
+typedef struct {
+    complexity_t order;
+    /* Median slope of log time against log size */
+    double slope;
+    /* Median slope of each model over the same sizes */
+    double model_slope[O_COUNT];
+    /* 0 when the runner-up is as close, approaching 1 otherwise */
+    double confidence;
+} complexity_fit_t;
+
+/* Return printable name of model, such as "O(n log n)" */
+const char *complexity_name(complexity_t order);
+
+/*
+ * Parse model given as "1", "logn", "n", "nlogn" or "n2".
+ * Return O_COUNT if not recognized.
+ */
+complexity_t complexity_parse(const char *name);
+
+/*
+ * Fit cnt samples (increasing sizes n[i] > 1, times t[i]) to all models.
+ * Return false if fewer than two or more than COMPLEXITY_MAX_SAMPLES
+ * samples, or invalid ones, were given.
+ */
+bool complexity_fit(const double *n,
+                    const double *t,
+                    int cnt,
+                    complexity_fit_t *fit);
+
+#endif /* LAB0_COMPLEXITY_H */
@@ -7,16 +7,24 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "record.h"
 #include "report.h"
 
+/* Our program needs to use regular malloc/free */
+#define INTERNAL 1
+#include "harness.h"
+
 /* Some global values */
 int simulation = 0;
 static cmd_ptr cmd_list = NULL;
@@ -34,6 +42,10 @@ static double last_time;
 /*
  * Implement buffered I/O using variant of RIO package from CS:APP
  * Must create stack of buffers to handle I/O with nested source commands.
+ *
+ * Regular files are mapped into memory instead, so that lines are found with
+ * memchr and handed out in place, without copying.  The mapping is private
+ * and writable, which lets the command line be tokenized where it lies.
  */
 
 #define RIO_BUFSIZE 8192
@@ -44,12 +56,33 @@ struct RIO_ELE {
     int cnt;               /* Unread bytes in internal buffer */
     char *bufptr;          /* Next unread byte in internal buffer */
     char buf[RIO_BUFSIZE]; /* Internal buffer */
+    char *map;             /* Mapped file contents, NULL if using buf */
+    size_t map_len;        /* Size of mapped file */
+    size_t map_pos;        /* Offset of next unread byte in map */
     rio_ptr prev;          /* Next element in stack */
 };
 
 static rio_ptr buf_stack;
 static char linebuf[RIO_BUFSIZE];
 
+/* Command line is split into this array, in place */
+#define MAXARGS (RIO_BUFSIZE / 2)
+static char *argv_buf[MAXARGS];
+
+/*
+ * Commands and parameters are kept in sorted lists for display, and are
+ * looked up through open addressing hash tables.  The tables are rebuilt
+ * lazily on the first lookup after a registration.
+ */
+typedef struct {
+    void **slots;  /* cmd_ptr or param_ptr, NULL if empty */
+    size_t mask;   /* Number of slots minus one */
+    bool dirty;    /* Registrations since last rebuild */
+} name_table_t;
+
+static name_table_t cmd_table = {NULL, 0, true};
+static name_table_t param_table = {NULL, 0, true};
+
 /* Maximum file descriptor */
 static int fd_max = 0;
 
@@ -76,6 +109,91 @@ static void pop_file();
 
 static bool interpret_cmda(int argc, char *argv[]);
 
+/* Nesting of commands run by other commands, such as time */
+static int cmd_depth = 0;
+
+/* Optional function sampled into the record after each command */
+static int (*record_probe)(void) = NULL;
+
+static bool do_record(int argc, char *argv[]);
+
+
+/* FNV-1a hash of a name */
+static uint32_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h ^= (uint8_t) *name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void table_clear(name_table_t *table)
+{
+    if (table->slots)
+        free_array(table->slots, table->mask + 1, sizeof(void *));
+    table->slots = NULL;
+    table->mask = 0;
+    table->dirty = true;
+}
+
+/*
+ * Rebuild table from a list, keeping it at most half full.  next_off and
+ * name_off are the offsets of the next and name fields in a list element.
+ */
+static void table_build(name_table_t *table,
+                        void *list,
+                        size_t next_off,
+                        size_t name_off)
+{
+    size_t cnt = 0;
+    for (char *ele = list; ele; ele = *(char **) (ele + next_off))
+        cnt++;
+
+    table_clear(table);
+    size_t size = 8;
+    while (size < 2 * cnt)
+        size <<= 1;
+    table->slots = calloc_or_fail(size, sizeof(void *), "table_build");
+    table->mask = size - 1;
+
+    for (char *ele = list; ele; ele = *(char **) (ele + next_off)) {
+        size_t i = name_hash(*(char **) (ele + name_off)) & table->mask;
+        while (table->slots[i])
+            i = (i + 1) & table->mask;
+        table->slots[i] = ele;
+    }
+    table->dirty = false;
+}
+
+static void *table_find(name_table_t *table, const char *name, size_t name_off)
+{
+    size_t i = name_hash(name) & table->mask;
+    char *ele;
+    while ((ele = table->slots[i])) {
+        if (strcmp(*(char **) (ele + name_off), name) == 0)
+            return ele;
+        i = (i + 1) & table->mask;
+    }
+    return NULL;
+}
+
+static cmd_ptr find_cmd(const char *name)
+{
+    if (cmd_table.dirty)
+        table_build(&cmd_table, cmd_list, offsetof(cmd_ele, next),
+                    offsetof(cmd_ele, name));
+    return table_find(&cmd_table, name, offsetof(cmd_ele, name));
+}
+
+static param_ptr find_param(const char *name)
+{
+    if (param_table.dirty)
+        table_build(&param_table, param_list, offsetof(param_ele, next),
+                    offsetof(param_ele, name));
+    return table_find(&param_table, name, offsetof(param_ele, name));
+}
 
 /* Add a new command */
 void add_cmd(char *name, cmd_function operation, char *documentation)
@@ -93,6 +211,7 @@ void add_cmd(char *name, cmd_function operation, char *documentation)
     ele->documentation = documentation;
     ele->next = next_cmd;
     *last_loc = ele;
+    cmd_table.dirty = true;
 }
 
 /* Add a new parameter */
@@ -100,6 +219,15 @@ void add_param(char *name,
                int *valp,
                char *documentation,
                setter_function setter)
+{
+    add_named_param(name, valp, NULL, documentation, setter);
+}
+
+void add_named_param(char *name,
+                     int *valp,
+                     const char *const *names,
+                     char *documentation,
+                     setter_function setter)
 {
     param_ptr next_param = param_list;
     param_ptr *last_loc = &param_list;
@@ -113,54 +241,39 @@ void add_param(char *name,
     ele->valp = valp;
     ele->documentation = documentation;
     ele->setter = setter;
+    ele->names = names;
     ele->next = next_param;
     *last_loc = ele;
+    param_table.dirty = true;
 }
 
-/* Parse a string into a command line */
-static char **parse_args(char *line, int *argcp)
+/*
+ * Split a command line into words, in place.  White space following each
+ * word is overwritten with a null character and argv points into line.
+ * Return the number of words, or -1 if there are more than maxargs.
+ */
+static int parse_args(char *line, char **argv, int maxargs)
 {
-    /*
-     * Must first determine how many arguments there are.
-     * Replace all white space with null characters
-     */
-    size_t len = strlen(line);
-    /* First copy into buffer with each substring null-terminated */
-    char *buf = malloc_or_fail(len + 1, "parse_args");
-    buf[len] = '\0';
-    char *src = line;
-    char *dst = buf;
-    bool skipping = true;
-    int c;
     int argc = 0;
-    while ((c = *src++) != '\0') {
-        if (isspace(c)) {
-            if (!skipping) {
-                /* Hit end of word */
-                *dst++ = '\0';
-                skipping = true;
-            }
-        } else {
-            if (skipping) {
-                /* Hit start of new word */
-                argc++;
-                skipping = false;
-            }
-            *dst++ = c;
-        }
-    }
+    char *src = line;
 
-    /* Now assemble into array of strings */
-    char **argv = calloc_or_fail(argc, sizeof(char *), "parse_args");
-    src = buf;
-    for (int i = 0; i < argc; i++) {
-        argv[i] = strsave_or_fail(src, "parse_args");
-        src += strlen(argv[i]) + 1;
+    while (*src) {
+        while (isspace(*src))
+            src++;
+        if (!*src)
+            break;
+
+        /* Hit start of new word */
+        if (argc == maxargs)
+            return -1;
+        argv[argc++] = src;
+        while (*src && !isspace(*src))
+            src++;
+        if (*src)
+            *src++ = '\0';
     }
 
-    free_block(buf, len + 1);
-    *argcp = argc;
-    return argv;
+    return argc;
 }
 
 static void record_error()
@@ -172,18 +285,47 @@ static void record_error()
     }
 }
 
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Append a command and its outcome to the record.  The outcome goes into an
+ * annotation line starting with "##", which the interpreter skips, so that
+ * the record can be run again as a command file.
+ */
+static void record_command(int argc, char *argv[], bool ok, uint64_t ns)
+{
+    for (int i = 0; i < argc; i++)
+        record_printf("%s%c", argv[i], i + 1 < argc ? ' ' : '\n');
+    record_printf("## ok=%d ns=%" PRIu64, ok, ns);
+    if (record_probe)
+        record_printf(" size=%d", record_probe());
+    record_printf("\n");
+}
+
 /* Execute a command that has already been split into arguments */
 static bool interpret_cmda(int argc, char *argv[])
 {
     if (argc == 0)
         return true;
     /* Try to find matching command */
-    cmd_ptr next_cmd = cmd_list;
+    cmd_ptr next_cmd = find_cmd(argv[0]);
     bool ok = true;
-    while (next_cmd && strcmp(argv[0], next_cmd->name) != 0)
-        next_cmd = next_cmd->next;
     if (next_cmd) {
+        bool recording = record_active() && cmd_depth == 0 &&
+                         next_cmd->operation != do_record;
+        uint64_t start = recording ? now_ns() : 0;
+
+        cmd_depth++;
         ok = next_cmd->operation(argc, argv);
+        cmd_depth--;
+
+        if (recording)
+            record_command(argc, argv, ok, now_ns() - start);
         if (!ok)
             record_error();
     } else {
@@ -204,14 +346,21 @@ static bool interpret_cmd(char *cmdline)
 #if RPT >= 6
     report(6, "Interpreting command '%s'\n", cmdline);
 #endif
-    int argc;
-    char **argv = parse_args(cmdline, &argc);
-    bool ok = interpret_cmda(argc, argv);
-    for (int i = 0; i < argc; i++)
-        free_string(argv[i]);
-    free_array(argv, argc, sizeof(char *));
+    /* Annotation lines, as written by record */
+    char *start = cmdline;
+    while (isspace(*start))
+        start++;
+    if (start[0] == '#' && start[1] == '#')
+        return true;
 
-    return ok;
+    int argc = parse_args(cmdline, argv_buf, MAXARGS);
+    if (argc < 0) {
+        report(1, "Too many arguments, at most %d allowed", MAXARGS);
+        record_error();
+        return false;
+    }
+
+    return interpret_cmda(argc, argv_buf);
 }
 
 /* Set function to be executed as part of program exit */
@@ -246,10 +395,16 @@ static bool do_quit(int argc, char *argv[])
         p = p->next;
         free_block(ele, sizeof(param_ele));
     }
+    cmd_list = NULL;
+    param_list = NULL;
+    table_clear(&cmd_table);
+    table_clear(&param_table);
 
     while (buf_stack)
         pop_file();
 
+    record_close();
+
     for (int i = 0; i < quit_helper_cnt; i++) {
         ok = ok && quit_helpers[i](argc, argv);
     }
@@ -258,6 +413,15 @@ static bool do_quit(int argc, char *argv[])
     return ok;
 }
 
+static void report_param(param_ptr p)
+{
+    if (p->names)
+        report(1, "\t%s\t%s\t%s", p->name, p->names[*p->valp],
+               p->documentation);
+    else
+        report(1, "\t%s\t%d\t%s", p->name, *p->valp, p->documentation);
+}
+
 static bool do_help(int argc, char *argv[])
 {
     cmd_ptr clist = cmd_list;
@@ -269,8 +433,7 @@ static bool do_help(int argc, char *argv[])
     param_ptr plist = param_list;
     report(1, "Options:");
     while (plist) {
-        report(1, "\t%s\t%d\t%s", plist->name, *plist->valp,
-               plist->documentation);
+        report_param(plist);
         plist = plist->next;
     }
     return true;
@@ -302,14 +465,22 @@ bool get_int(char *vname, int *loc)
     return true;
 }
 
+/* Return index of text in NULL terminated names, -1 if not found */
+static int get_name(const char *const *names, const char *text)
+{
+    for (int i = 0; names[i]; i++)
+        if (!strcmp(names[i], text))
+            return i;
+    return -1;
+}
+
 static bool do_option(int argc, char *argv[])
 {
     if (argc == 1) {
         param_ptr plist = param_list;
         report(1, "Options:");
         while (plist) {
-            report(1, "\t%s\t%d\t%s", plist->name, *plist->valp,
-                   plist->documentation);
+            report_param(plist);
             plist = plist->next;
         }
         return true;
@@ -318,32 +489,33 @@ static bool do_option(int argc, char *argv[])
     for (int i = 1; i < argc; i++) {
         char *name = argv[i];
         int value = 0;
-        bool found = false;
         /* Get value from next argument */
         if (i + 1 >= argc) {
             report(1, "No value given for parameter %s", name);
             return false;
-        } else if (!get_int(argv[++i], &value)) {
-            report(1, "Cannot parse '%s' as integer", argv[i]);
-            return false;
         }
-        /* Find parameter in list */
-        param_ptr plist = param_list;
-        while (!found && plist) {
-            if (strcmp(plist->name, name) == 0) {
-                int oldval = *plist->valp;
-                *plist->valp = value;
-                if (plist->setter)
-                    plist->setter(oldval);
-                found = true;
-            } else
-                plist = plist->next;
-        }
-        /* Didn't find parameter */
-        if (!found) {
+        /* Find parameter */
+        param_ptr plist = find_param(name);
+        if (!plist) {
             report(1, "Unknown parameter '%s'", name);
             return false;
         }
+        if (plist->names) {
+            value = get_name(plist->names, argv[++i]);
+            if (value < 0) {
+                report(1, "Unknown value '%s' of parameter %s", argv[i],
+                       name);
+                return false;
+            }
+        } else if (!get_int(argv[++i], &value)) {
+            report(1, "Cannot parse '%s' as integer", argv[i]);
+            return false;
+        }
+
+        int oldval = *plist->valp;
+        *plist->valp = value;
+        if (plist->setter)
+            plist->setter(oldval);
     }
 
     return true;
@@ -398,6 +570,311 @@ static bool do_time(int argc, char *argv[])
     return ok;
 }
 
+/* Parse duration such as "50ms", "2s" or "50" (milliseconds) */
+static bool get_duration(char *vname, int *ms)
+{
+    char *end = NULL;
+    long int v = strtol(vname, &end, 10);
+    if (end == vname || v < 0 || v > INT_MAX)
+        return false;
+
+    if (*end == '\0' || strcmp(end, "ms") == 0)
+        *ms = (int) v;
+    else if (strcmp(end, "s") == 0 && v <= INT_MAX / 1000)
+        *ms = (int) v * 1000;
+    else
+        return false;
+    return true;
+}
+
+static bool do_deadline(int argc, char *argv[])
+{
+    if (argc < 3) {
+        report(1, "%s needs a time limit and a command", argv[0]);
+        return false;
+    }
+
+    int ms;
+    if (!get_duration(argv[1], &ms)) {
+        report(1, "Cannot parse '%s' as time limit", argv[1]);
+        return false;
+    }
+
+    int saved_limit = time_limit;
+    time_limit = ms;
+    bool ok = interpret_cmda(argc - 2, argv + 2);
+    time_limit = saved_limit;
+
+    return ok;
+}
+
+/*
+ * Binary traces, as produced by scripts/tracec.py, hold a command stream
+ * that is already split into words.  Header integers are little-endian,
+ * all other integers are unsigned LEB128 varints.
+ *
+ *   header   "QTRC", u16 version, u16 reserved, u32 nstrings, u32 nrecords
+ *   strings  nstrings times: length, bytes (no terminating null)
+ *   records  nrecords times: argc, repeat, argc times string index
+ *
+ * The first word of a record is the opcode, and is resolved to its command
+ * once when the trace is loaded.  Executing a record then calls the command
+ * repeat times, without tokenizing or echoing.
+ */
+#define TRACE_MAGIC "QTRC"
+#define TRACE_VERSION 1
+
+typedef struct {
+    cmd_ptr cmd;
+    uint32_t repeat;
+    int argc;
+    char **argv;
+} trace_record_t;
+
+typedef struct {
+    const uint8_t *pos;
+    const uint8_t *end;
+} trace_reader_t;
+
+static bool trace_read(trace_reader_t *r, void *dst, size_t len)
+{
+    if ((size_t) (r->end - r->pos) < len)
+        return false;
+    memcpy(dst, r->pos, len);
+    r->pos += len;
+    return true;
+}
+
+static bool trace_u16(trace_reader_t *r, uint16_t *v)
+{
+    uint8_t b[2];
+    if (!trace_read(r, b, sizeof(b)))
+        return false;
+    *v = b[0] | b[1] << 8;
+    return true;
+}
+
+static bool trace_u32(trace_reader_t *r, uint32_t *v)
+{
+    uint8_t b[4];
+    if (!trace_read(r, b, sizeof(b)))
+        return false;
+    *v = b[0] | b[1] << 8 | b[2] << 16 | (uint32_t) b[3] << 24;
+    return true;
+}
+
+static bool trace_varint(trace_reader_t *r, uint32_t *v)
+{
+    *v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (r->pos == r->end)
+            return false;
+        uint8_t b = *r->pos++;
+        *v |= (uint32_t) (b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/* Decoded trace, with all strings and argument vectors in single blocks */
+typedef struct {
+    char *text;
+    size_t text_len;
+    char **strings;
+    uint32_t nstrings;
+    char **args;
+    size_t nargs;
+    trace_record_t *records;
+    uint32_t nrecords;
+} trace_t;
+
+static void trace_free(trace_t *trace)
+{
+    free(trace->text);
+    free(trace->strings);
+    free(trace->args);
+    free(trace->records);
+}
+
+static bool trace_decode(trace_t *trace, const uint8_t *data, size_t len)
+{
+    trace_reader_t r = {data, data + len};
+    char magic[4];
+    uint16_t version, reserved;
+
+    memset(trace, 0, sizeof(*trace));
+    if (!trace_read(&r, magic, sizeof(magic)) ||
+        memcmp(magic, TRACE_MAGIC, sizeof(magic)) ||
+        !trace_u16(&r, &version) || !trace_u16(&r, &reserved) ||
+        !trace_u32(&r, &trace->nstrings) || !trace_u32(&r, &trace->nrecords)) {
+        report(1, "Not a binary trace");
+        return false;
+    }
+    if (version != TRACE_VERSION) {
+        report(1, "Unsupported binary trace version %u", version);
+        return false;
+    }
+    /* Every string and record takes at least one byte */
+    if (trace->nstrings > len || trace->nrecords > len) {
+        report(1, "Corrupted binary trace");
+        return false;
+    }
+
+    /* Strings are copied into one block, each followed by a null */
+    trace->text = malloc(len);
+    trace->strings = calloc(trace->nstrings, sizeof(char *));
+    trace->records = calloc(trace->nrecords, sizeof(trace_record_t));
+    if (!trace->text || (trace->nstrings && !trace->strings) ||
+        (trace->nrecords && !trace->records)) {
+        report(1, "Out of memory loading binary trace");
+        return false;
+    }
+
+    char *text = trace->text;
+    for (uint32_t i = 0; i < trace->nstrings; i++) {
+        uint32_t slen;
+        if (!trace_varint(&r, &slen) || !trace_read(&r, text, slen)) {
+            report(1, "Truncated string table in binary trace");
+            return false;
+        }
+        text[slen] = '\0';
+        trace->strings[i] = text;
+        text += slen + 1;
+    }
+
+    /* Argument vectors reference the strings, so count words first */
+    const uint8_t *records = r.pos;
+    for (uint32_t i = 0; i < trace->nrecords; i++) {
+        uint32_t argc, repeat, index;
+        if (!trace_varint(&r, &argc) || !trace_varint(&r, &repeat) ||
+            argc > (size_t) (r.end - r.pos)) {
+            report(1, "Truncated record %u in binary trace", i);
+            return false;
+        }
+        for (uint32_t j = 0; j < argc; j++) {
+            if (!trace_varint(&r, &index)) {
+                report(1, "Truncated record %u in binary trace", i);
+                return false;
+            }
+        }
+        trace->nargs += argc;
+    }
+    trace->args = calloc(trace->nargs + 1, sizeof(char *));
+    if (!trace->args) {
+        report(1, "Out of memory loading binary trace");
+        return false;
+    }
+
+    r.pos = records;
+    char **args = trace->args;
+    for (uint32_t i = 0; i < trace->nrecords; i++) {
+        trace_record_t *rec = &trace->records[i];
+        uint32_t argc;
+        trace_varint(&r, &argc);
+        trace_varint(&r, &rec->repeat);
+        rec->argc = argc;
+        rec->argv = args;
+        for (uint32_t j = 0; j < argc; j++) {
+            uint32_t index;
+            trace_varint(&r, &index);
+            if (index >= trace->nstrings) {
+                report(1, "Bad string index in record %u of binary trace", i);
+                return false;
+            }
+            *args++ = trace->strings[index];
+        }
+
+        if (argc && !(rec->cmd = find_cmd(rec->argv[0]))) {
+            report(1, "Unknown command '%s' in record %u of binary trace",
+                   rec->argv[0], i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool do_replay(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs a binary trace file", argv[0]);
+        return false;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        report(1, "Could not open binary trace '%s'", argv[1]);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    void *data = NULL;
+    if (st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+            data = NULL;
+    }
+    close(fd);
+    if (!data) {
+        report(1, "Could not read binary trace '%s'", argv[1]);
+        return false;
+    }
+
+    trace_t trace;
+    bool ok = trace_decode(&trace, data, st.st_size);
+    munmap(data, st.st_size);
+    if (!ok) {
+        trace_free(&trace);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < trace.nrecords && !quit_flag; i++) {
+        trace_record_t *rec = &trace.records[i];
+        if (!rec->cmd)
+            continue;
+        for (uint32_t n = 0; n < rec->repeat && !quit_flag; n++) {
+            if (!rec->cmd->operation(rec->argc, rec->argv)) {
+                record_error();
+                ok = false;
+            }
+        }
+    }
+
+    trace_free(&trace);
+    return ok;
+}
+
+static bool do_record(int argc, char *argv[])
+{
+    if (argc > 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    if (argc == 1) {
+        if (!record_active()) {
+            report(1, "Not recording");
+            return false;
+        }
+        record_close();
+        return true;
+    }
+
+    if (!record_open(argv[1])) {
+        report(1, "Could not open record file '%s'", argv[1]);
+        return false;
+    }
+    return true;
+}
+
+void set_record_probe(int (*probe)(void))
+{
+    record_probe = probe;
+}
+
 /* Initialize interpreter */
 void init_cmd()
 {
@@ -412,11 +889,21 @@ void init_cmd()
     ADD_COMMAND(source, " file           | Read commands from source file");
     ADD_COMMAND(log, " file           | Copy output to file");
     ADD_COMMAND(time, " cmd arg ...    | Time command execution");
+    ADD_COMMAND(replay, " file           | Execute commands of binary trace");
+    ADD_COMMAND(record,
+                " [file]         | Record commands with outcome and time to "
+                "file.  Stop recording if no file given");
+    ADD_COMMAND(deadline,
+                " t cmd arg ...  | Run command with time limit t "
+                "(e.g. 50ms, 2s)");
     add_cmd("#", do_comment_cmd, " ...            | Display comment");
     add_param("simulation", &simulation, "Start/Stop simulation mode", NULL);
     add_param("verbose", &verblevel, "Verbosity level", NULL);
     add_param("error", &err_limit, "Number of errors until exit", NULL);
     add_param("echo", &echo, "Do/don't echo commands", NULL);
+    add_param("timelimit", &time_limit,
+              "Time limit of each operation in milliseconds (0: unlimited)",
+              NULL);
 
     init_in();
     init_time(&last_time);
@@ -441,7 +928,23 @@ static bool push_file(char *fname)
     rnew->fd = fd;
     rnew->cnt = 0;
     rnew->bufptr = rnew->buf;
+    rnew->map = NULL;
+    rnew->map_len = 0;
+    rnew->map_pos = 0;
     rnew->prev = buf_stack;
+
+    /* Pipes and terminals cannot be mapped and keep using the buffer */
+    struct stat st;
+    if (fname && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            rnew->map = map;
+            rnew->map_len = st.st_size;
+        }
+    }
     buf_stack = rnew;
 
     return true;
@@ -453,6 +956,8 @@ static void pop_file()
     if (buf_stack) {
         rio_ptr rsave = buf_stack;
         buf_stack = rsave->prev;
+        if (rsave->map)
+            munmap(rsave->map, rsave->map_len);
         close(rsave->fd);
         free_block(rsave, sizeof(rio_t));
     }
@@ -464,6 +969,43 @@ static void init_in()
     buf_stack = NULL;
 }
 
+/* Read command from mapped input file.
+ * The newline is replaced by a null character and the line is returned in
+ * place.  Only a last line without newline needs to be copied.
+ */
+static char *readline_map()
+{
+    rio_ptr rio = buf_stack;
+    char *line = rio->map + rio->map_pos;
+    size_t left = rio->map_len - rio->map_pos;
+
+    if (!left) {
+        /* Encountered EOF */
+        pop_file();
+        return NULL;
+    }
+
+    char *end = memchr(line, '\n', left);
+    if (end) {
+        *end = '\0';
+        rio->map_pos += end - line + 1;
+    } else {
+        /* Last line of file did not terminate with newline */
+        size_t len = left < RIO_BUFSIZE - 1 ? left : RIO_BUFSIZE - 1;
+        memcpy(linebuf, line, len);
+        linebuf[len] = '\0';
+        line = linebuf;
+        rio->map_pos = rio->map_len;
+    }
+
+    if (echo) {
+        report_noreturn(1, prompt);
+        report_noreturn(1, "%s\n", line);
+    }
+
+    return line;
+}
+
 /* Read command from input file.
  * When hit EOF, close that file and return NULL
  */
@@ -476,6 +1018,9 @@ static char *readline()
     if (!buf_stack)
         return NULL;
 
+    if (buf_stack->map)
+        return readline_map();
+
     for (cnt = 0; cnt < RIO_BUFSIZE - 2; cnt++) {
         if (buf_stack->cnt <= 0) {
             /* Need to read from input file */
@@ -647,9 +1192,10 @@ bool run_console(char *infile_name)
     if (!has_infile) {
         char *cmdline;
         while ((cmdline = linenoise(prompt)) != NULL) {
-            interpret_cmd(cmdline);
+            /* Save before the line is split in place */
             linenoiseHistoryAdd(cmdline);       /* Add to the history. */
             linenoiseHistorySave(HISTORY_FILE); /* Save the history on disk. */
+            interpret_cmd(cmdline);
             linenoiseFree(cmdline);
         }
     } else {
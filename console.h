@@ -35,6 +35,8 @@ struct PELE {
     char *documentation;
     /* Function that gets called whenever parameter changes */
     setter_function setter;
+    /* Names of values 0, 1, ..., NULL terminated, or NULL if numeric */
+    const char *const *names;
     param_ptr next;
 };
 
@@ -51,6 +53,16 @@ void add_param(char *name,
                char *doccumentation,
                setter_function setter);
 
+/*
+ * Add a parameter whose value is given by name, names[i] standing for i.
+ * names is NULL terminated.
+ */
+void add_named_param(char *name,
+                     int *valp,
+                     const char *const *names,
+                     char *documentation,
+                     setter_function setter);
+
 /* Extract integer from text and store at loc */
 bool get_int(char *vname, int *loc);
 
@@ -60,6 +72,9 @@ void add_quit_helper(cmd_function qf);
 /* Turn echoing on/off */
 void set_echo(bool on);
 
+/* Set function whose value is logged after each recorded command */
+void set_record_probe(int (*probe)(void));
+
 /* Complete command interpretation */
 
 /* Return true if no errors occurred */
@@ -10,8 +10,15 @@
 #include "queue.h"
 #include "random.h"
 
+/* Our program needs to use regular malloc/free */
+#define INTERNAL 1
+#include "harness.h"
+
 #define N_MEASURE 150
 
+/* Largest queue size used as input of a measurement */
+#define DUT_MAX_SIZE 10000
+
 /* Allow random number range from 0 to 65535 */
 const size_t chunk_size = 16;
 
@@ -20,31 +27,104 @@ const size_t n_measure = N_MEASURE;
 
 const int drop_size = 20;
 
-/* Maintain a queue independent from the qtest since
- * we do not want the test to affect the original functionality
+/*
+ * Maintain queues independent from the qtest since we do not want the test
+ * to affect the original functionality.
+ *
+ * Instead of building and freeing a queue around every measurement, each
+ * class keeps its own queue alive across samples and only grows or shrinks
+ * it to the size requested by the input.  The nodes come from a pool that
+ * is populated once, so the setup between two measurements consists of a
+ * few pointer updates rather than thousands of allocations.
  */
-static struct list_head *l = NULL;
+static struct list_head *pool = NULL;
+static struct list_head *l[2] = {NULL, NULL};
+static size_t l_size[2] = {0, 0};
+
+/* Size class 1 queue takes while class 0 is measured */
+static uint16_t shadow_size[N_MEASURE];
 
 static char random_string[N_MEASURE][8];
 static int random_string_iter = 0;
 
-enum {
-    test_insert_head,
-    test_insert_tail,
-    test_remove_head,
-    test_remove_tail,
-};
+char *get_random_string(void)
+{
+    random_string_iter = (random_string_iter + 1) % N_MEASURE;
+    return random_string[random_string_iter];
+}
+
+static void fill_random_strings(void)
+{
+    for (size_t i = 0; i < N_MEASURE; ++i) {
+        /* Generate random string of lowercase letters */
+        randombytes((uint8_t *) random_string[i], 7);
+        for (size_t j = 0; j < 7; j++)
+            random_string[i][j] = 'a' + (uint8_t) random_string[i][j] % 26;
+        random_string[i][7] = 0;
+    }
+}
 
 /* Implement the necessary queue interface to simulation */
 void init_dut(void)
 {
-    l = NULL;
+    if (pool)
+        return;
+
+    pool = q_new();
+    l[0] = q_new();
+    l[1] = q_new();
+    if (!pool || !l[0] || !l[1]) {
+        fprintf(stderr, "Could not allocate queues for simulation\n");
+        exit(111);
+    }
+    l_size[0] = l_size[1] = 0;
+
+    fill_random_strings();
+    /* Class 0 holds at most one node, class 1 at most DUT_MAX_SIZE */
+    for (size_t i = 0; i < DUT_MAX_SIZE + 1; i++) {
+        if (!q_insert_head(pool, get_random_string())) {
+            fprintf(stderr, "Could not populate node pool for simulation\n");
+            exit(111);
+        }
+    }
+}
+
+void free_dut(void)
+{
+    /* Freeing the pool in cautious mode would be quadratic */
+    set_cautious_mode(false);
+    q_free(pool);
+    q_free(l[0]);
+    q_free(l[1]);
+    set_cautious_mode(true);
+
+    pool = l[0] = l[1] = NULL;
 }
 
-char *get_random_string(void)
+/* Move nodes between pool and queue of class until it holds size nodes */
+static void dut_resize(uint8_t class, size_t size)
 {
-    random_string_iter = (random_string_iter + 1) % N_MEASURE;
-    return random_string[random_string_iter];
+    while (l_size[class] < size && !list_empty(pool)) {
+        list_move(pool->next, l[class]);
+        l_size[class]++;
+    }
+    while (l_size[class] > size) {
+        list_move(l[class]->next, pool);
+        l_size[class]--;
+    }
+}
+
+/*
+ * Load the nodes next to both ends of q into the cache.  The setup leaves
+ * them hot or cold depending on the class, which would otherwise show up in
+ * the timing of an operation that is constant time in instruction count.
+ */
+static void dut_warm(struct list_head *q)
+{
+    struct list_head *volatile p;
+    p = q->next->next;
+    p = q->prev->prev;
+    (void) p;
 }
 
 void prepare_inputs(uint8_t *input_data, uint8_t *classes)
@@ -55,87 +135,202 @@ void prepare_inputs(uint8_t *input_data, uint8_t *classes)
         if (classes[i] == 0)
             memset(input_data + (size_t) i * chunk_size, 0, chunk_size);
     }
+    randombytes((uint8_t *) shadow_size, sizeof(shadow_size));
 
-    for (size_t i = 0; i < N_MEASURE; ++i) {
-        /* Generate random string */
-        randombytes((uint8_t *) random_string[i], 7);
-        random_string[i][7] = 0;
+    fill_random_strings();
+}
+
+/* State of one sample, passed from setup to operation to teardown */
+typedef struct {
+    struct list_head *q;
+    uint8_t class;
+    const uint8_t *input;
+    char *s;
+    element_t *e;
+    bool ok;
+} dut_sample_t;
+
+/*
+ * Descriptor of a measured operation.  setup brings the queue of the class
+ * into the state given by the input, run is the timed region, and teardown
+ * returns what run consumed or produced to the pool.
+ */
+typedef struct {
+    void (*setup)(dut_sample_t *sample, size_t shadow);
+    void (*run)(dut_sample_t *sample);
+    void (*teardown)(dut_sample_t *sample);
+} dut_op_t;
+
+/* Size of queue an operation takes when input size is its contents */
+#define DUT_FIXED_SIZE 16
+
+/* Queue of class takes size from input, at least min_size nodes */
+static void setup_sized(dut_sample_t *sample, size_t shadow, size_t min_size)
+{
+    size_t range = DUT_MAX_SIZE - min_size;
+    size_t size = *(uint16_t *) sample->input % range + min_size;
+
+    /*
+     * Class 1 queue is resized for every sample, even when measuring
+     * class 0, so that the memory traffic preceding a measurement does
+     * not depend on the class.
+     */
+    dut_resize(sample->class, size);
+    if (sample->class == 0)
+        dut_resize(1, shadow % range + min_size);
+}
+
+static void setup_insert(dut_sample_t *sample, size_t shadow)
+{
+    setup_sized(sample, shadow, 0);
+}
+
+/* Removal is measured on a non-empty queue in both classes */
+static void setup_remove(dut_sample_t *sample, size_t shadow)
+{
+    setup_sized(sample, shadow, 1);
+}
+
+/*
+ * Queue of class holds DUT_FIXED_SIZE nodes, and the input is spread over
+ * their strings.  Class 0 thus always sees identical strings, class 1 sees
+ * random ones, which reveals operations whose timing depends on contents.
+ */
+static void setup_fixed(dut_sample_t *sample, size_t shadow)
+{
+    (void) shadow;
+    dut_resize(sample->class, DUT_FIXED_SIZE);
+
+    size_t k = 0;
+    struct list_head *node;
+    list_for_each (node, sample->q) {
+        char *value = list_entry(node, element_t, list)->value;
+        for (size_t j = 0; j < 7; j++, k++)
+            value[j] = 'a' + sample->input[k % chunk_size] % 26;
+        value[7] = '\0';
     }
 }
 
+static void run_insert_head(dut_sample_t *sample)
+{
+    sample->ok = q_insert_head(sample->q, sample->s);
+}
+
+static void run_insert_tail(dut_sample_t *sample)
+{
+    sample->ok = q_insert_tail(sample->q, sample->s);
+}
+
+static void run_remove_head(dut_sample_t *sample)
+{
+    sample->e = q_remove_head(sample->q, NULL, 0);
+}
+
+static void run_remove_tail(dut_sample_t *sample)
+{
+    sample->e = q_remove_tail(sample->q, NULL, 0);
+}
+
+static void run_size(dut_sample_t *sample)
+{
+    sample->ok = q_size(sample->q) == DUT_FIXED_SIZE;
+}
+
+static void run_delete_mid(dut_sample_t *sample)
+{
+    sample->ok = q_delete_mid(sample->q);
+}
+
+static void run_swap(dut_sample_t *sample)
+{
+    q_swap(sample->q);
+}
+
+static void run_reverse(dut_sample_t *sample)
+{
+    q_reverse(sample->q);
+}
+
+static void run_sort(dut_sample_t *sample)
+{
+    q_sort(sample->q);
+}
+
+static void teardown_insert_head(dut_sample_t *sample)
+{
+    if (sample->ok)
+        q_release_element(q_remove_head(sample->q, NULL, 0));
+}
+
+static void teardown_insert_tail(dut_sample_t *sample)
+{
+    if (sample->ok)
+        q_release_element(q_remove_tail(sample->q, NULL, 0));
+}
+
+/* Removed nodes go back to the pool */
+static void teardown_remove(dut_sample_t *sample)
+{
+    if (sample->e) {
+        list_add(&sample->e->list, pool);
+        l_size[sample->class]--;
+    }
+}
+
+/* The deleted node was freed, so a fresh one takes its place */
+static void teardown_delete_mid(dut_sample_t *sample)
+{
+    if (sample->ok && !q_insert_tail(sample->q, sample->s))
+        l_size[sample->class]--;
+}
+
+static void teardown_none(dut_sample_t *sample)
+{
+    (void) sample;
+}
+
+static const dut_op_t dut_ops[] = {
+    [test_insert_head] = {setup_insert, run_insert_head, teardown_insert_head},
+    [test_insert_tail] = {setup_insert, run_insert_tail, teardown_insert_tail},
+    [test_remove_head] = {setup_remove, run_remove_head, teardown_remove},
+    [test_remove_tail] = {setup_remove, run_remove_tail, teardown_remove},
+    [test_size] = {setup_fixed, run_size, teardown_none},
+    [test_delete_mid] = {setup_fixed, run_delete_mid, teardown_delete_mid},
+    [test_swap] = {setup_fixed, run_swap, teardown_none},
+    [test_reverse] = {setup_fixed, run_reverse, teardown_none},
+    [test_sort] = {setup_fixed, run_sort, teardown_none},
+};
+
 void measure(int64_t *before_ticks,
              int64_t *after_ticks,
              uint8_t *input_data,
+             uint8_t *classes,
              int mode)
 {
-    assert(mode == test_insert_head || mode == test_insert_tail ||
-           mode == test_remove_head || mode == test_remove_tail);
-
-    switch (mode) {
-    case test_insert_head:
-        for (size_t i = drop_size; i < n_measure - drop_size; i++) {
-            char *s = get_random_string();
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * chunk_size) % 10000);
-            before_ticks[i] = cpucycles();
-            dut_insert_head(s, 1);
-            after_ticks[i] = cpucycles();
-            dut_free();
-        }
-        break;
-    case test_insert_tail:
-        for (size_t i = drop_size; i < n_measure - drop_size; i++) {
-            char *s = get_random_string();
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * chunk_size) % 10000);
-            before_ticks[i] = cpucycles();
-            dut_insert_tail(s, 1);
-            after_ticks[i] = cpucycles();
-            dut_free();
-        }
-        break;
-    case test_remove_head:
-        for (size_t i = drop_size; i < n_measure - drop_size; i++) {
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * chunk_size) % 10000);
-            before_ticks[i] = cpucycles();
-            element_t *e = q_remove_head(l, NULL, 0);
-            after_ticks[i] = cpucycles();
-            if (e)
-                q_release_element(e);
-            dut_free();
-        }
-        break;
-    case test_remove_tail:
-        for (size_t i = drop_size; i < n_measure - drop_size; i++) {
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * chunk_size) % 10000);
-            before_ticks[i] = cpucycles();
-            element_t *e = q_remove_tail(l, NULL, 0);
-            after_ticks[i] = cpucycles();
-            if (e)
-                q_release_element(e);
-            dut_free();
-        }
-        break;
-    default:
-        for (size_t i = drop_size; i < n_measure - drop_size; i++) {
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * chunk_size) % 10000);
-            before_ticks[i] = cpucycles();
-            dut_size(1);
-            after_ticks[i] = cpucycles();
-            dut_free();
-        }
+    assert(mode >= 0 && mode < test_count);
+    const dut_op_t *op = &dut_ops[mode];
+
+    /* Releasing a node must not depend on the number of live blocks */
+    set_cautious_mode(false);
+
+    /* Both classes are measured in one pass, in the random input order */
+    for (size_t i = drop_size; i < n_measure - drop_size; i++) {
+        dut_sample_t sample = {
+            .q = l[classes[i]],
+            .class = classes[i],
+            .input = input_data + i * chunk_size,
+            .s = get_random_string(),
+        };
+
+        op->setup(&sample, shadow_size[i]);
+        dut_warm(sample.q);
+
+        before_ticks[i] = cpucycles();
+        op->run(&sample);
+        after_ticks[i] = cpucycles();
+
+        op->teardown(&sample);
     }
+
+    set_cautious_mode(true);
 }
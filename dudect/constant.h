@@ -2,35 +2,30 @@
 #define DUDECT_CONSTANT_H
 
 #include <stdint.h>
-#define dut_new() ((void) (l = q_new()))
 
-#define dut_size(n)                                \
-    do {                                           \
-        for (int __iter = 0; __iter < n; ++__iter) \
-            q_size(l);                             \
-    } while (0)
-
-#define dut_insert_head(s, n)    \
-    do {                         \
-        int j = n;               \
-        while (j--)              \
-            q_insert_head(l, s); \
-    } while (0)
-
-#define dut_insert_tail(s, n)    \
-    do {                         \
-        int j = n;               \
-        while (j--)              \
-            q_insert_tail(l, s); \
-    } while (0)
-
-#define dut_free() ((void) (q_free(l)))
+/* Operations that can be measured */
+enum {
+    test_insert_head,
+    test_insert_tail,
+    test_remove_head,
+    test_remove_tail,
+    test_size,
+    test_delete_mid,
+    test_swap,
+    test_reverse,
+    test_sort,
+    test_count,
+};
 
+/* Create node pool and per-class queues; no effect if already created */
 void init_dut();
+/* Release node pool and per-class queues */
+void free_dut();
 void prepare_inputs(uint8_t *input_data, uint8_t *classes);
 void measure(int64_t *before_ticks,
              int64_t *after_ticks,
              uint8_t *input_data,
+             uint8_t *classes,
              int mode);
 
 #endif
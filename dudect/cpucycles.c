@@ -0,0 +1,50 @@
+#include "cpucycles.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#define CALIBRATION_ROUNDS 1000
+
+int cpucycles_backend = CPUCYCLES_FENCED;
+int64_t cpucycles_overhead = 0;
+
+bool cpucycles_supported(int backend)
+{
+    switch (backend) {
+    case CPUCYCLES_PLAIN:
+    case CPUCYCLES_FENCED:
+        return true;
+    case CPUCYCLES_RDTSCP: {
+#if defined(__i386__) || defined(__x86_64__)
+        unsigned int eax, ebx, ecx, edx;
+        /* CPUID.80000001H:EDX[27] reports RDTSCP */
+        if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx))
+            return false;
+        return edx & (1U << 27);
+#else
+        return false;
+#endif
+    }
+    default:
+        return false;
+    }
+}
+
+/*
+ * The cost of reading the counter is included in every measurement.  Take
+ * the smallest difference of back-to-back reads as the fixed overhead, so
+ * that it can be subtracted without producing negative durations.
+ */
+void cpucycles_calibrate(void)
+{
+    int64_t best = INT64_MAX;
+
+    for (int i = 0; i < CALIBRATION_ROUNDS; i++) {
+        int64_t before = cpucycles();
+        int64_t after = cpucycles();
+        if (after - before >= 0 && after - before < best)
+            best = after - before;
+    }
+    cpucycles_overhead = best == INT64_MAX ? 0 : best;
+}
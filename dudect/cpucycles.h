@@ -1,10 +1,54 @@
+#ifndef DUDECT_CPUCYCLES_H
+#define DUDECT_CPUCYCLES_H
+
+#include <stdbool.h>
 #include <stdint.h>
+
+/*
+ * Cycle counter backends, selectable at runtime.
+ *
+ * A bare rdtsc may execute before earlier instructions have retired, or
+ * after later ones have started, which smears the measured region.  The
+ * fenced variants wait for preceding instructions to complete and keep
+ * following ones from starting before the counter is read.
+ */
+enum {
+    CPUCYCLES_PLAIN,  /* rdtsc / cntvct_el0 */
+    CPUCYCLES_FENCED, /* lfence; rdtsc; lfence / isb; cntvct_el0; isb */
+    CPUCYCLES_RDTSCP, /* rdtscp; lfence (x86 only) */
+    CPUCYCLES_COUNT,
+};
+
+/* Selected backend, one of the values above */
+extern int cpucycles_backend;
+
+/* Cycles spent by back-to-back reads of the counter, see cpucycles_calibrate */
+extern int64_t cpucycles_overhead;
+
+/* Return true if backend is available on this machine */
+bool cpucycles_supported(int backend);
+
+/* Measure the overhead of the selected backend */
+void cpucycles_calibrate(void);
+
 // http://www.intel.com/content/www/us/en/embedded/training/ia-32-ia-64-benchmark-code-execution-paper.html
 static inline int64_t cpucycles(void)
 {
 #if defined(__i386__) || defined(__x86_64__)
     unsigned int hi, lo;
-    __asm__ volatile("rdtsc\n\t" : "=a"(lo), "=d"(hi));
+    switch (cpucycles_backend) {
+    case CPUCYCLES_FENCED:
+        __asm__ volatile("lfence\n\trdtsc\n\tlfence"
+                         : "=a"(lo), "=d"(hi)::"memory");
+        break;
+    case CPUCYCLES_RDTSCP:
+        __asm__ volatile("rdtscp\n\tlfence"
+                         : "=a"(lo), "=d"(hi)::"ecx", "memory");
+        break;
+    default:
+        __asm__ volatile("rdtsc\n\t" : "=a"(lo), "=d"(hi));
+        break;
+    }
     return ((int64_t) lo) | (((int64_t) hi) << 32);
 
 #elif defined(__aarch64__)
@@ -15,9 +59,14 @@ static inline int64_t cpucycles(void)
      * bits wide and it is attributed with the flag 'cap_user_time_short'
      * is true.
      */
-    asm volatile("mrs %0, cntvct_el0" : "=r"(val));
+    if (cpucycles_backend == CPUCYCLES_FENCED)
+        asm volatile("isb\n\tmrs %0, cntvct_el0\n\tisb" : "=r"(val)::"memory");
+    else
+        asm volatile("mrs %0, cntvct_el0" : "=r"(val));
     return val;
 #else
 #error Unsupported Architecture
 #endif
 }
+
+#endif
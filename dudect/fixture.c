@@ -26,26 +26,60 @@
  *    variable time.
  */
 
+#define _GNU_SOURCE /* CPU_SET, sched_getaffinity, sched_setaffinity */
 #include "fixture.h"
 #include <assert.h>
 #include <math.h>
+#include <sched.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "../console.h"
 #include "../random.h"
 #include "constant.h"
+#include "cpucycles.h"
 #include "ttest.h"
 
 #define enough_measure 10000
 #define test_tries 10
 
+/* Upper bound of worker processes measuring in parallel */
+#define max_workers 8
+
+/* Number of cropped t-tests, each keeping a different fraction of timings */
+#define n_percentiles 20
+
+/*
+ * Layout of the battery of t-tests:
+ *  t[0]                  uncropped measurements
+ *  t[1 .. n_percentiles] measurements below the matching cropping threshold
+ *  t[n_percentiles + 1]  second order test on centered, squared timings
+ */
+#define n_tests (n_percentiles + 2)
+#define second_order_test (n_percentiles + 1)
+
+/* Samples per class the uncropped test needs before second order starts */
+#define second_order_warmup 1000
+
+/* Tests with fewer samples are too noisy to take part in max t selection */
+#define min_test_samples (enough_measure / 10)
+
 extern const int drop_size;
 extern const size_t chunk_size;
 extern const size_t n_measure;
 static t_ctx *t;
 
+/* Cropping thresholds, fixed by the first batch of each try */
+static int64_t percentiles[n_percentiles];
+static bool percentiles_ready;
+
+/* Means of each class the second order test centers on, once settled */
+static double centers[2];
+static bool centers_ready;
+
 /* threshold values for Welch's t-test */
 enum {
     t_threshold_bananas = 500, /* Test failed with overwhelming probability */
@@ -61,12 +95,53 @@ static void differentiate(int64_t *exec_times,
                           const int64_t *before_ticks,
                           const int64_t *after_ticks)
 {
-    for (size_t i = 0; i < n_measure; i++)
+    for (size_t i = 0; i < n_measure; i++) {
         exec_times[i] = after_ticks[i] - before_ticks[i];
+        /* Remove the cost of reading the counter, keeping valid samples */
+        if (exec_times[i] > 0) {
+            exec_times[i] -= cpucycles_overhead;
+            if (exec_times[i] <= 0)
+                exec_times[i] = 1;
+        }
+    }
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Derive the cropping thresholds from one batch of timings.  Test i keeps
+ * the fastest 1 - 0.5^(10 * (i + 1) / n_percentiles) of measurements, so the
+ * thresholds get denser towards the fat right tail.  Only the thresholds
+ * are retained; later batches are streamed into the t-tests.
+ */
+static void prepare_percentiles(const int64_t *exec_times)
+{
+    int64_t sorted[n_measure];
+    size_t n = 0;
+
+    for (size_t i = 0; i < n_measure; i++)
+        if (exec_times[i] > 0)
+            sorted[n++] = exec_times[i];
+    if (!n)
+        return;
+
+    qsort(sorted, n, sizeof(int64_t), cmp_int64);
+    for (size_t i = 0; i < n_percentiles; i++) {
+        double which = 1 - pow(0.5, 10 * (double) (i + 1) / n_percentiles);
+        percentiles[i] = sorted[(size_t) (which * n)];
+    }
+    percentiles_ready = true;
 }
 
 static void update_statistics(const int64_t *exec_times, uint8_t *classes)
 {
+    if (!percentiles_ready)
+        prepare_percentiles(exec_times);
+
     for (size_t i = 0; i < n_measure; i++) {
         int64_t difference = exec_times[i];
         /* CPU cycle counter overflowed or dropped measurement */
@@ -74,24 +149,90 @@ static void update_statistics(const int64_t *exec_times, uint8_t *classes)
             continue;
 
         /* do a t-test on the execution time */
-        t_push(t, difference, classes[i]);
+        t_push(&t[0], difference, classes[i]);
+
+        /* do a t-test on cropped execution times, for several thresholds */
+        for (size_t crop = 0; crop < n_percentiles; crop++) {
+            if (difference < percentiles[crop])
+                t_push(&t[crop + 1], difference, classes[i]);
+        }
+
+        /* do a second order test once the mean estimates have settled */
+        if (centers_ready) {
+            double centered = difference - centers[classes[i]];
+            t_push(&t[second_order_test], centered * centered, classes[i]);
+        }
+    }
+}
+
+/*
+ * Fix the centers of the second order test once the uncropped test has
+ * enough samples of both classes.  Workers only see their own share of
+ * the samples, so this is only called on the merged statistics.
+ */
+static void settle_centers(void)
+{
+    if (centers_ready || t[0].n[0] <= second_order_warmup ||
+        t[0].n[1] <= second_order_warmup)
+        return;
+
+    centers[0] = t[0].mean[0];
+    centers[1] = t[0].mean[1];
+    centers_ready = true;
+}
+
+/* Rounds expected to bring both classes of t[0] past the warmup */
+static int warmup_rounds(void)
+{
+    double missing = 0;
+    for (int c = 0; c < 2; c++) {
+        double m = second_order_warmup + 1 - t[0].n[c];
+        if (m > missing)
+            missing = m;
     }
+    /* Classes are drawn evenly, so a round brings half its samples each */
+    return (int) (2 * missing / (n_measure - drop_size * 2)) + 1;
+}
+
+/* Return the test with the largest |t| among those with enough samples */
+static t_ctx *max_test(void)
+{
+    t_ctx *best = &t[0];
+    double best_t = fabs(t_compute(best));
+
+    for (size_t i = 1; i < n_tests; i++) {
+        if (t[i].n[0] + t[i].n[1] < min_test_samples)
+            continue;
+        double x = fabs(t_compute(&t[i]));
+        if (x > best_t) {
+            best = &t[i];
+            best_t = x;
+        }
+    }
+    return best;
 }
 
 static bool report(void)
 {
-    double max_t = fabs(t_compute(t));
-    double number_traces_max_t = t->n[0] + t->n[1];
+    t_ctx *worst = max_test();
+    double max_t = fabs(t_compute(worst));
+    double number_traces_max_t = worst->n[0] + worst->n[1];
     double max_tau = max_t / sqrt(number_traces_max_t);
 
     printf("\033[A\033[2K");
     printf("meas: %7.2lf M, ", (number_traces_max_t / 1e6));
-    if (number_traces_max_t < enough_measure) {
+    if (t[0].n[0] + t[0].n[1] < enough_measure) {
         printf("not enough measurements (%.0f still to go).\n",
-               enough_measure - number_traces_max_t);
+               enough_measure - t[0].n[0] - t[0].n[1]);
         return false;
     }
 
+    /* max_test would silently skip it, so this is a bug in the fixture */
+    if (!t[second_order_test].n[0] || !t[second_order_test].n[1]) {
+        fprintf(stderr, "\nERROR: second order test collected no samples\n");
+        die();
+    }
+
     /* max_t: the t statistic value
      * max_tau: a t value normalized by sqrt(number of measurements).
      *          this way we can compare max_tau taken with different
@@ -117,7 +258,7 @@ static bool report(void)
     return true;
 }
 
-static bool doit(int mode)
+static void doit(int mode)
 {
     int64_t *before_ticks = calloc(n_measure + 1, sizeof(int64_t));
     int64_t *after_ticks = calloc(n_measure + 1, sizeof(int64_t));
@@ -132,61 +273,229 @@ static bool doit(int mode)
 
     prepare_inputs(input_data, classes);
 
-    measure(before_ticks, after_ticks, input_data, mode);
+    measure(before_ticks, after_ticks, input_data, classes, mode);
     differentiate(exec_times, before_ticks, after_ticks);
     update_statistics(exec_times, classes);
-    bool ret = report();
 
     free(before_ticks);
     free(after_ticks);
     free(exec_times);
     free(classes);
     free(input_data);
+}
+
+/* CPUs this process may run on, as inherited from taskset or cgroups */
+static bool allowed_cpus(cpu_set_t *cpus)
+{
+    CPU_ZERO(cpus);
+    return !sched_getaffinity(0, sizeof(*cpus), cpus) && CPU_COUNT(cpus) > 0;
+}
+
+static int n_workers(void)
+{
+    cpu_set_t cpus;
+    long n = allowed_cpus(&cpus) ? CPU_COUNT(&cpus)
+                                 : sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1)
+        return 1;
+    return n < max_workers ? (int) n : max_workers;
+}
+
+/* Return the index-th CPU of cpus, or -1 if there are not that many */
+static int nth_cpu(const cpu_set_t *cpus, int index)
+{
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, cpus) && index-- == 0)
+            return c;
+    }
+    return -1;
+}
 
-    return ret;
+static bool read_full(int fd, void *buf, size_t len)
+{
+    while (len) {
+        ssize_t n = read(fd, buf, len);
+        if (n <= 0)
+            return false;
+        buf = (char *) buf + n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * Spread rounds of doit() over worker processes, one per core.  Worker w is
+ * pinned to the w-th CPU this process is allowed to run on, and owns a private copy of the queues and of
+ * the t-test contexts, so no state is shared while measuring.  When done, a
+ * worker sends its statistics through a pipe and they are merged into t.
+ * The cropping thresholds, and the centers of the second order test once
+ * settled, must be known before forking so that every worker uses the same
+ * values.
+ *
+ * Processes are used rather than threads since the queues under test, the
+ * random strings feeding them and t are globals, and fork() gives every
+ * worker its own copy for free.  Return false if no worker could be started.
+ */
+static bool run_workers(int mode, int rounds, int workers)
+{
+    int fds[max_workers];
+    pid_t pids[max_workers];
+    int started = 0;
+    cpu_set_t allowed;
+    bool pin = allowed_cpus(&allowed);
+
+    /* Do not duplicate pending output in the children */
+    fflush(stdout);
+
+    for (int w = 0; w < workers; w++) {
+        int share = rounds / workers + (w < rounds % workers);
+        int pipefd[2];
+        if (pipe(pipefd))
+            break;
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(pipefd[0]);
+            close(pipefd[1]);
+            break;
+        }
+
+        if (pid == 0) {
+            close(pipefd[0]);
+            int cpu = pin ? nth_cpu(&allowed, w) : -1;
+            if (cpu >= 0) {
+                cpu_set_t cpus;
+                CPU_ZERO(&cpus);
+                CPU_SET(cpu, &cpus);
+                sched_setaffinity(0, sizeof(cpus), &cpus);
+            }
+
+            for (size_t i = 0; i < n_tests; i++)
+                t_init(&t[i]);
+            for (int i = 0; i < share; i++)
+                doit(mode);
+            size_t len = n_tests * sizeof(t_ctx);
+            bool ok = write(pipefd[1], t, len) == (ssize_t) len;
+            _exit(ok ? 0 : 1);
+        }
+
+        close(pipefd[1]);
+        fds[started] = pipefd[0];
+        pids[started++] = pid;
+    }
+
+    for (int w = 0; w < started; w++) {
+        t_ctx part[n_tests];
+        int status;
+        if (read_full(fds[w], part, sizeof(part))) {
+            for (size_t i = 0; i < n_tests; i++)
+                t_merge(&t[i], &part[i]);
+        }
+        close(fds[w]);
+        waitpid(pids[w], &status, 0);
+    }
+
+    return started > 0;
 }
 
 static void init_once(void)
 {
     init_dut();
-    t_init(t);
+    cpucycles_calibrate();
+    for (size_t i = 0; i < n_tests; i++)
+        t_init(&t[i]);
+    percentiles_ready = false;
+    centers_ready = false;
 }
 
 static bool TEST_CONST(char *text, int mode)
 {
     bool result = false;
-    t = malloc(sizeof(t_ctx));
+    t = malloc(n_tests * sizeof(t_ctx));
+    if (!t)
+        die();
 
     for (int cnt = 0; cnt < test_tries; ++cnt) {
         printf("Testing %s...(%d/%d)\n\n", text, cnt, test_tries);
         init_once();
-        for (int i = 0; i < enough_measure / (n_measure - drop_size * 2) + 1;
-             ++i)
-            result = doit(mode);
+        int rounds = enough_measure / (n_measure - drop_size * 2) + 1;
+        int workers = n_workers();
+        bool parallel = workers > 1 && rounds > 1;
+        if (parallel) {
+            /* The first round fixes the cropping thresholds */
+            doit(mode);
+            rounds--;
+        }
+        /* Then the merged means settle before the second order test */
+        while (parallel && !centers_ready && rounds > 0) {
+            int warmup = warmup_rounds();
+            if (warmup > rounds)
+                warmup = rounds;
+            parallel = run_workers(mode, warmup, workers);
+            if (parallel) {
+                rounds -= warmup;
+                settle_centers();
+            }
+        }
+        if (parallel && (!rounds || run_workers(mode, rounds, workers))) {
+            result = report();
+        } else {
+            for (int i = 0; i < rounds; ++i) {
+                doit(mode);
+                settle_centers();
+                result = report();
+            }
+        }
         printf("\033[A\033[2K\033[A\033[2K");
         if (result == true)
             break;
     }
+    free_dut();
     free(t);
     return result;
 }
 
 bool is_insert_head_const(void)
 {
-    return TEST_CONST("insert_head", 0);
+    return TEST_CONST("insert_head", test_insert_head);
 }
 
 bool is_insert_tail_const(void)
 {
-    return TEST_CONST("insert_tail", 1);
+    return TEST_CONST("insert_tail", test_insert_tail);
 }
 
 bool is_remove_head_const(void)
 {
-    return TEST_CONST("remove_head", 2);
+    return TEST_CONST("remove_head", test_remove_head);
 }
 
 bool is_remove_tail_const(void)
 {
-    return TEST_CONST("remove_tail", 3);
+    return TEST_CONST("remove_tail", test_remove_tail);
+}
+
+bool is_size_const(void)
+{
+    return TEST_CONST("size", test_size);
+}
+
+bool is_delete_mid_const(void)
+{
+    return TEST_CONST("delete_mid", test_delete_mid);
+}
+
+bool is_swap_const(void)
+{
+    return TEST_CONST("swap", test_swap);
+}
+
+bool is_reverse_const(void)
+{
+    return TEST_CONST("reverse", test_reverse);
+}
+
+bool is_sort_const(void)
+{
+    return TEST_CONST("sort", test_sort);
 }
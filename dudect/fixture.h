@@ -10,4 +10,11 @@ bool is_insert_tail_const(void);
 bool is_remove_head_const(void);
 bool is_remove_tail_const(void);
 
+/* Operations on a queue of fixed size, with class-dependent contents */
+bool is_size_const(void);
+bool is_delete_mid_const(void);
+bool is_swap_const(void);
+bool is_reverse_const(void);
+bool is_sort_const(void);
+
 #endif
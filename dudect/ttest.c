@@ -28,6 +28,25 @@ void t_push(t_ctx *ctx, double x, uint8_t class)
     ctx->m2[class] = ctx->m2[class] + delta * (x - ctx->mean[class]);
 }
 
+/* Combine statistics of src into ctx, as if all samples were pushed to ctx.
+ * See Chan et al., "Updating Formulae and a Pairwise Algorithm for Computing
+ * Sample Variances".
+ */
+void t_merge(t_ctx *ctx, const t_ctx *src)
+{
+    for (int class = 0; class < 2; class ++) {
+        double n = ctx->n[class] + src->n[class];
+        if (n == 0)
+            continue;
+
+        double delta = src->mean[class] - ctx->mean[class];
+        ctx->mean[class] += delta * src->n[class] / n;
+        ctx->m2[class] += src->m2[class] +
+                          delta * delta * ctx->n[class] * src->n[class] / n;
+        ctx->n[class] = n;
+    }
+}
+
 double t_compute(t_ctx *ctx)
 {
     double var[2] = {0.0, 0.0};
@@ -9,6 +9,7 @@ typedef struct {
 } t_ctx;
 
 void t_push(t_ctx *ctx, double x, uint8_t class);
+void t_merge(t_ctx *ctx, const t_ctx *src);
 double t_compute(t_ctx *ctx);
 void t_init(t_ctx *ctx);
 
@@ -1,10 +1,13 @@
 /* Test support code */
 
+#include <pthread.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 #include "report.h"
@@ -35,36 +38,67 @@
  */
 typedef struct BELE {
     struct BELE *next, *prev;
+    struct heap *owner;        /* Heap of allocating thread */
+    struct BELE *remote_next;  /* Link in remote list of owner */
     size_t payload_size;
     size_t magic_header; /* Marker to see if block seems legitimate */
     unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_ele_t;
 
-static block_ele_t *allocated = NULL;
-static size_t allocated_count = 0;
+/*
+ * Every thread keeps its own list of allocated blocks, so threads allocate
+ * and free without contention.  A block freed by another thread is pushed
+ * onto the remote list of its owner, still linked, and unlinked by the
+ * owner on its next call.  Heaps of exited threads are handed to new ones.
+ */
+typedef struct heap {
+    block_ele_t *allocated;
+    size_t allocated_count;
+    _Atomic(block_ele_t *) remote;
+    bool orphaned; /* Thread has exited, protected by heaps_lock */
+    struct heap *next;
+} heap_t;
+
+/* Registry of heaps.  Entries are only added, so walking needs no lock */
+static _Atomic(heap_t *) heaps = NULL;
+static pthread_mutex_t heaps_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t heap_key;
+static pthread_once_t heap_key_once = PTHREAD_ONCE_INIT;
+static __thread heap_t *heap = NULL;
 
 /* Percent probability of malloc failure */
 int fail_probability = 0;
 
 static bool cautious_mode = true;
 static bool noallocate_mode = false;
-static bool error_occurred = false;
-static char *error_message = "";
+static atomic_bool error_occurred = false;
+static __thread char *error_message = "";
 
-static int time_limit = 1;
+/* Time limit of risky operations in milliseconds (0: unlimited) */
+int time_limit = 1000;
 
 /*
- * Data for managing exceptions
+ * Data for managing exceptions, one context per thread
  */
-static jmp_buf env;
-static volatile sig_atomic_t jmp_ready = false;
-static bool time_limited = false;
+static __thread jmp_buf env;
+static __thread volatile sig_atomic_t jmp_ready = false;
+static __thread bool time_limited = false;
 
 /*
  * Internal functions
  */
 
+/* Arm (or with ms == 0, disarm) one-shot SIGALRM timer */
+static void set_timer(int ms)
+{
+    struct itimerval it = {
+        .it_interval = {0, 0},
+        .it_value = {ms / 1000, (ms % 1000) * 1000},
+    };
+    setitimer(ITIMER_REAL, &it, NULL);
+}
+
 /* Should this allocation fail? */
 static bool fail_allocation()
 {
@@ -72,6 +106,81 @@ static bool fail_allocation()
     return (weight < 0.01 * fail_probability);
 }
 
+static void orphan_heap(void *h)
+{
+    pthread_mutex_lock(&heaps_lock);
+    ((heap_t *) h)->orphaned = true;
+    pthread_mutex_unlock(&heaps_lock);
+}
+
+static void make_heap_key()
+{
+    pthread_key_create(&heap_key, orphan_heap);
+}
+
+/* Heap of calling thread, adopting an orphaned one if possible */
+static heap_t *get_heap()
+{
+    if (heap)
+        return heap;
+
+    pthread_once(&heap_key_once, make_heap_key);
+    pthread_mutex_lock(&heaps_lock);
+    heap_t *h = atomic_load(&heaps);
+    while (h && !h->orphaned)
+        h = h->next;
+    if (h) {
+        h->orphaned = false;
+    } else if ((h = calloc(1, sizeof(heap_t)))) {
+        h->next = atomic_load(&heaps);
+        atomic_store(&heaps, h);
+    }
+    pthread_mutex_unlock(&heaps_lock);
+
+    if (h)
+        pthread_setspecific(heap_key, h);
+    heap = h;
+    return h;
+}
+
+static void unlink_block(heap_t *h, block_ele_t *b)
+{
+    block_ele_t *bn = b->next;
+    block_ele_t *bp = b->prev;
+    if (bp)
+        bp->next = bn;
+    else
+        h->allocated = bn;
+    if (bn)
+        bn->prev = bp;
+
+    free(b);
+    h->allocated_count--;
+}
+
+/* Unlink blocks freed by other threads.  Only the owner may call this */
+static void drain_remote(heap_t *h)
+{
+    if (!atomic_load_explicit(&h->remote, memory_order_relaxed))
+        return;
+
+    block_ele_t *b = atomic_exchange_explicit(&h->remote, NULL,
+                                              memory_order_acquire);
+    while (b) {
+        block_ele_t *next = b->remote_next;
+        unlink_block(h, b);
+        b = next;
+    }
+}
+
+static bool is_heap(heap_t *h)
+{
+    for (heap_t *r = atomic_load(&heaps); r; r = r->next)
+        if (r == h)
+            return true;
+    return false;
+}
+
 /*
  * Find header of block, given its payload.
  * Signal error if doesn't seem like legitimate block
@@ -85,13 +194,19 @@ static block_ele_t *find_header(void *p)
 
     block_ele_t *b = (block_ele_t *) ((size_t) p - sizeof(block_ele_t));
     if (cautious_mode) {
-        /* Make sure this is really an allocated block */
-        block_ele_t *ab = allocated;
+        /*
+         * Make sure this is really an allocated block.  Lists of other
+         * threads cannot be searched safely, so their blocks are only
+         * checked to be owned by a known heap.
+         */
+        block_ele_t *ab = heap ? heap->allocated : NULL;
         bool found = false;
         while (ab && !found) {
             found = ab == b;
             ab = ab->next;
         }
+        if (!found && b->magic_header == MAGICHEADER && b->owner != heap)
+            found = is_heap(b->owner);
         if (!found) {
             report_event(MSG_ERROR,
                          "Attempted to free unallocated block.  Address = %p",
@@ -134,12 +249,14 @@ void *test_malloc(size_t size)
         return NULL;
     }
 
+    heap_t *h = get_heap();
     block_ele_t *new_block =
-        malloc(size + sizeof(block_ele_t) + sizeof(size_t));
+        h ? malloc(size + sizeof(block_ele_t) + sizeof(size_t)) : NULL;
     if (!new_block) {
         report_event(MSG_FATAL, "Couldn't allocate any more memory");
         error_occurred = true;
     }
+    drain_remote(h);
 
     // cppcheck-suppress nullPointerRedundantCheck
     new_block->magic_header = MAGICHEADER;
@@ -149,14 +266,15 @@ void *test_malloc(size_t size)
     void *p = (void *) &new_block->payload;
     memset(p, FILLCHAR, size);
     // cppcheck-suppress nullPointerRedundantCheck
-    new_block->next = allocated;
+    new_block->next = h->allocated;
     // cppcheck-suppress nullPointerRedundantCheck
     new_block->prev = NULL;
+    new_block->owner = h;
 
-    if (allocated)
-        allocated->prev = new_block;
-    allocated = new_block;
-    allocated_count++;
+    if (h->allocated)
+        h->allocated->prev = new_block;
+    h->allocated = new_block;
+    h->allocated_count++;
 
     return p;
 }
@@ -196,18 +314,20 @@ void test_free(void *p)
     *find_footer(b) = MAGICFREE;
     memset(p, FILLCHAR, b->payload_size);
 
-    /* Unlink from list */
-    block_ele_t *bn = b->next;
-    block_ele_t *bp = b->prev;
-    if (bp)
-        bp->next = bn;
-    else
-        allocated = bn;
-    if (bn)
-        bn->prev = bp;
+    heap_t *owner = b->owner;
+    if (owner == heap) {
+        drain_remote(owner);
+        unlink_block(owner, b);
+        return;
+    }
 
-    free(b);
-    allocated_count--;
+    /* Leave block linked for its owner to unlink */
+    block_ele_t *top = atomic_load_explicit(&owner->remote,
+                                            memory_order_relaxed);
+    do {
+        b->remote_next = top;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &owner->remote, &top, b, memory_order_release, memory_order_relaxed));
 }
 
 // cppcheck-suppress unusedFunction
@@ -223,7 +343,12 @@ char *test_strdup(const char *s)
 
 size_t allocation_check()
 {
-    return allocated_count;
+    size_t count = 0;
+    for (heap_t *h = atomic_load(&heaps); h; h = h->next) {
+        drain_remote(h);
+        count += h->allocated_count;
+    }
+    return count;
 }
 
 /*
@@ -253,9 +378,7 @@ void set_noallocate_mode(bool noallocate)
  */
 bool error_check()
 {
-    bool e = error_occurred;
-    error_occurred = false;
-    return e;
+    return atomic_exchange(&error_occurred, false);
 }
 
 /*
@@ -268,7 +391,7 @@ bool exception_setup(bool limit_time)
         /* Got here from longjmp */
         jmp_ready = false;
         if (time_limited) {
-            alarm(0);
+            set_timer(0);
             time_limited = false;
         }
 
@@ -280,8 +403,8 @@ bool exception_setup(bool limit_time)
 
     /* Got here from initial call */
     jmp_ready = true;
-    if (limit_time) {
-        alarm(time_limit);
+    if (limit_time && time_limit > 0) {
+        set_timer(time_limit);
         time_limited = true;
     }
     return true;
@@ -293,7 +416,7 @@ bool exception_setup(bool limit_time)
 void exception_cancel()
 {
     if (time_limited) {
-        alarm(0);
+        set_timer(0);
         time_limited = false;
     }
 
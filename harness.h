@@ -19,12 +19,18 @@ char *test_strdup(const char *s);
 
 #ifdef INTERNAL
 
-/* Report number of allocated blocks */
+/*
+ * Report number of allocated blocks, summed over all threads.  No other
+ * thread may be allocating or freeing at the time.
+ */
 size_t allocation_check();
 
 /* Probability of malloc failing, expressed as percent */
 extern int fail_probability;
 
+/* Time limit of risky operations in milliseconds (0: unlimited) */
+extern int time_limit;
+
 /*
  * Set/unset cautious mode.
  * In this mode, makes extra sure any block to be freed is currently allocated.
@@ -43,6 +49,8 @@ void set_noallocate_mode(bool noallocate);
 bool error_check();
 
 /*
+ * Each thread has its own exception context, errors are shared.
+ *
  * Prepare for a risky operation using setjmp.
  * Function returns true for initial return, false for error return
  */
@@ -0,0 +1,31 @@
+#ifndef LAB0_LAZY_H
+#define LAB0_LAZY_H
+
+/*
+ * Lazy reversal of the queues of queue.c.
+ *
+ * With lazy_reverse set, q_reverse only flips an orientation bit kept in
+ * the queue head, and the logical head of the queue is then the tail of
+ * the underlying list.  Code walking the list directly must either honor
+ * the bit or normalize the queue first.
+ */
+
+#include <stdbool.h>
+#include "list.h"
+
+/* Make q_reverse flip the orientation bit instead of relinking nodes */
+extern int lazy_reverse;
+
+/* Return true if the logical order of queue is opposite to its list order */
+bool q_reversed(struct list_head *head);
+
+/*
+ * Set the orientation bit without relinking.  Only meaningful for callers
+ * about to reorder the whole list, such as a sort.
+ */
+void q_set_reversed(struct list_head *head, bool reversed);
+
+/* Apply a pending reversal to the list itself */
+void q_normalize(struct list_head *head);
+
+#endif /* LAB0_LAZY_H */
@@ -0,0 +1,84 @@
+#include "mpmc.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+bool mpmc_init(mpmc_t *q, size_t capacity)
+{
+    size_t n = 2;
+    while (n < capacity)
+        n <<= 1;
+
+    q->cells = malloc(n * sizeof(mpmc_cell_t));
+    if (!q->cells)
+        return false;
+
+    /* Cell i is free for the producer at position i */
+    for (size_t i = 0; i < n; i++)
+        atomic_init(&q->cells[i].seq, i);
+    q->mask = n - 1;
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+    return true;
+}
+
+void mpmc_destroy(mpmc_t *q)
+{
+    free(q->cells);
+    q->cells = NULL;
+}
+
+bool mpmc_push(mpmc_t *q, element_t *e)
+{
+    mpmc_cell_t *cell;
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    while (true) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            /* Free for this position; claim it */
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            /* Still holds the element of the previous lap */
+            return false;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+
+    cell->e = e;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+element_t *mpmc_pop(mpmc_t *q)
+{
+    mpmc_cell_t *cell;
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    while (true) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+        if (diff == 0) {
+            /* Filled for this position; claim it */
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            /* Not filled yet */
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+
+    element_t *e = cell->e;
+    /* Free the cell for the producer one lap ahead */
+    atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+    return e;
+}
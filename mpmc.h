@@ -0,0 +1,53 @@
+#ifndef LAB0_MPMC_H
+#define LAB0_MPMC_H
+
+/*
+ * Bounded lock-free multi-producer multi-consumer queue of element_t.
+ *
+ * Dmitry Vyukov's array queue: every cell carries a sequence number which
+ * tells producers and consumers, racing on their own position counter,
+ * whether the cell is free to fill or ready to take.  Each operation costs
+ * one compare-and-swap when uncontended.  Cells are allocated once and the
+ * elements are owned by whoever holds them, so no memory is reclaimed
+ * while other threads may still read it.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "queue.h"
+
+/* Keep the two positions on separate cache lines */
+#define MPMC_LINE 64
+
+typedef struct {
+    atomic_size_t seq;
+    element_t *e;
+} mpmc_cell_t;
+
+typedef struct {
+    mpmc_cell_t *cells;
+    size_t mask;
+    char pad0[MPMC_LINE - sizeof(mpmc_cell_t *) - sizeof(size_t)];
+    atomic_size_t tail; /* Next cell to fill */
+    char pad1[MPMC_LINE - sizeof(atomic_size_t)];
+    atomic_size_t head; /* Next cell to take */
+    char pad2[MPMC_LINE - sizeof(atomic_size_t)];
+} mpmc_t;
+
+/*
+ * Set up queue holding up to capacity elements, rounded up to a power of
+ * two.  Return false if could not allocate space.
+ */
+bool mpmc_init(mpmc_t *q, size_t capacity);
+
+/* Release cells of queue, not the elements left in it */
+void mpmc_destroy(mpmc_t *q);
+
+/* Append e at tail.  Return false if queue is full */
+bool mpmc_push(mpmc_t *q, element_t *e);
+
+/* Take element from head.  Return NULL if queue is empty */
+element_t *mpmc_pop(mpmc_t *q);
+
+#endif /* LAB0_MPMC_H */
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "pq.h"
+
+/* Should a be closer to the top than b? */
+static inline bool before(const pq_t *pq,
+                          const element_t *a,
+                          const element_t *b)
+{
+    int cmp = strcmp(a->value, b->value);
+    return pq->max ? cmp > 0 : cmp < 0;
+}
+
+pq_t *pq_new(bool max)
+{
+    pq_t *pq = malloc(sizeof(pq_t));
+    if (!pq)
+        return NULL;
+
+    pq->items = malloc(PQ_MIN_CAPACITY * sizeof(element_t *));
+    if (!pq->items) {
+        free(pq);
+        return NULL;
+    }
+    pq->size = 0;
+    pq->capacity = PQ_MIN_CAPACITY;
+    pq->max = max;
+    return pq;
+}
+
+void pq_free(pq_t *pq)
+{
+    if (!pq)
+        return;
+
+    for (size_t i = 0; i < pq->size; i++)
+        q_release_element(pq->items[i]);
+    free(pq->items);
+    free(pq);
+}
+
+static bool grow(pq_t *pq)
+{
+    size_t capacity = pq->capacity * 2;
+    element_t **items = malloc(capacity * sizeof(element_t *));
+    if (!items)
+        return false;
+
+    memcpy(items, pq->items, pq->size * sizeof(element_t *));
+    free(pq->items);
+    pq->items = items;
+    pq->capacity = capacity;
+    return true;
+}
+
+/* Move hole at i up past parents that e should precede, then fill it */
+static void sift_up(pq_t *pq, size_t i, element_t *e)
+{
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!before(pq, e, pq->items[parent]))
+            break;
+        pq->items[i] = pq->items[parent];
+        i = parent;
+    }
+    pq->items[i] = e;
+}
+
+/* Move hole at i down past children that should precede e, then fill it */
+static void sift_down(pq_t *pq, size_t i, element_t *e)
+{
+    size_t child;
+    while ((child = 2 * i + 1) < pq->size) {
+        if (child + 1 < pq->size &&
+            before(pq, pq->items[child + 1], pq->items[child]))
+            child++;
+        if (!before(pq, pq->items[child], e))
+            break;
+        pq->items[i] = pq->items[child];
+        i = child;
+    }
+    pq->items[i] = e;
+}
+
+bool pq_push(pq_t *pq, const char *s)
+{
+    if (!pq || !s)
+        return false;
+    if (pq->size == pq->capacity && !grow(pq))
+        return false;
+
+    element_t *e = malloc(sizeof(element_t));
+    if (!e)
+        return false;
+    e->value = strdup(s);
+    if (!e->value) {
+        free(e);
+        return false;
+    }
+
+    sift_up(pq, pq->size++, e);
+    return true;
+}
+
+element_t *pq_pop(pq_t *pq, char *sp, size_t bufsize)
+{
+    if (!pq || !pq->size)
+        return NULL;
+
+    element_t *top = pq->items[0];
+    element_t *last = pq->items[--pq->size];
+    if (pq->size)
+        sift_down(pq, 0, last);
+
+    if (sp && bufsize) {
+        size_t len = strnlen(top->value, bufsize - 1);
+        memcpy(sp, top->value, len);
+        sp[len] = '\0';
+    }
+    return top;
+}
+
+const char *pq_peek(const pq_t *pq)
+{
+    return pq && pq->size ? pq->items[0]->value : NULL;
+}
+
+size_t pq_size(const pq_t *pq)
+{
+    return pq ? pq->size : 0;
+}
+
+size_t pq_blocks(const pq_t *pq)
+{
+    /* Structure, array, and element and string of each entry */
+    return pq ? 2 + 2 * pq->size : 0;
+}
@@ -0,0 +1,55 @@
+#ifndef LAB0_PQ_H
+#define LAB0_PQ_H
+
+/*
+ * Priority queue of element_t stored in a binary heap.
+ *
+ * Pointers to the elements are kept in a growable array ordered as a heap
+ * on their strings, so the smallest one, or the largest one in a max queue,
+ * is at index 0.  Insertion and extraction are O(log n) and peeking is
+ * O(1), so taking the first k strings costs O(k log n) instead of sorting
+ * the whole queue.  Memory is allocated through the harness.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "queue.h"
+
+/* Capacity of a new priority queue */
+#define PQ_MIN_CAPACITY 16
+
+typedef struct {
+    element_t **items;
+    size_t size;
+    size_t capacity;
+    /* Largest string first */
+    bool max;
+} pq_t;
+
+/* Create empty priority queue.  Return NULL if could not allocate space */
+pq_t *pq_new(bool max);
+
+/* Free priority queue and all elements in it */
+void pq_free(pq_t *pq);
+
+/* Insert copy of s.  Return false if could not allocate space */
+bool pq_push(pq_t *pq, const char *s);
+
+/*
+ * Remove smallest element, or largest one in a max queue, copying up to
+ * bufsize - 1 characters of its string to sp if non-NULL.  The returned
+ * element is released with q_release_element.
+ * Return NULL if priority queue is NULL or empty.
+ */
+element_t *pq_pop(pq_t *pq, char *sp, size_t bufsize);
+
+/* Return string that pq_pop would remove, NULL if empty */
+const char *pq_peek(const pq_t *pq);
+
+/* Return number of elements in priority queue */
+size_t pq_size(const pq_t *pq);
+
+/* Return number of harness blocks held by priority queue */
+size_t pq_blocks(const pq_t *pq);
+
+#endif /* LAB0_PQ_H */
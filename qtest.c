@@ -2,19 +2,31 @@
 
 #include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <spawn.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h> /* strcasecmp */
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
+#include "backend.h"
+#include "complexity.h"
+#include "dudect/cpucycles.h"
 #include "dudect/fixture.h"
+#include "lazy.h"
 #include "list.h"
 #include "list_sort.h"
+#include "mpmc.h"
+#include "pq.h"
+#include "shmq.h"
+#include "wsdeque.h"
 
 /* Our program needs to use regular malloc/free */
 #define INTERNAL 1
@@ -26,6 +38,9 @@
 /* How much padding should be added to check for string overrun? */
 #define STRINGPAD MAXSTRING
 
+/* Padding checked for overrun in fast remove mode */
+#define CANARY_LEN 16
+
 /*
  * It is a bit sketchy to use this #include file on the solution version of the
  * code.
@@ -35,6 +50,7 @@
 #include "queue.h"
 
 #include "console.h"
+#include "record.h"
 #include "report.h"
 
 /* Settable parameters */
@@ -60,13 +76,22 @@ int compare_element_t(void *priv,
 
 /* List being tested */
 typedef struct {
-    struct list_head *l;
+    /* Queue created by ops, NULL if none */
+    void *q;
+    /* Backend of last queue created, operations on NULL go there too */
+    const queue_ops_t *ops;
     /* meta data of list */
     int size;
 } list_head_meta_t;
 
 static list_head_meta_t l_meta;
 
+/* Priority queue of the pq command, kept apart from the queue */
+static pq_t *prio = NULL;
+
+/* Index in backend_names of backend used by 'new' without argument */
+static int backend = 0;
+
 /* Number of elements in queue */
 static size_t lcnt = 0;
 
@@ -76,6 +101,14 @@ static int fail_count = 0;
 
 static int string_length = MAXSTRING;
 
+/*
+ * In fast remove mode, removed strings are copied into a buffer reused by
+ * every removal, and only a short canary past its end is checked.
+ */
+static int fast_remove = 0;
+static char *remove_buf = NULL;
+static int remove_buf_length = -1;
+
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
@@ -97,23 +130,24 @@ static bool do_free(int argc, char *argv[])
     }
 
     bool ok = true;
-    if (!l_meta.l)
+    if (!l_meta.q)
         report(3, "Warning: Calling free on null queue");
     error_check();
 
     if (lcnt > big_list_size)
         set_cautious_mode(false);
     if (exception_setup(true))
-        q_free(l_meta.l);
+        l_meta.ops->free(l_meta.q);
     exception_cancel();
     set_cautious_mode(true);
 
     l_meta.size = 0;
-    l_meta.l = NULL;
+    l_meta.q = NULL;
     lcnt = 0;
     show_queue(3);
 
-    size_t bcnt = allocation_check();
+    /* Blocks of the priority queue remain */
+    size_t bcnt = allocation_check() - pq_blocks(prio);
     if (bcnt > 0) {
         report(1, "ERROR: Freed queue, but %lu blocks are still allocated",
                bcnt);
@@ -125,20 +159,27 @@ static bool do_free(int argc, char *argv[])
 
 static bool do_new(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+    if (argc > 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    int index = argc == 2 ? backend_find(argv[1]) : backend;
+    if (index < 0) {
+        report(1, "Unknown backend '%s'", argv[1]);
         return false;
     }
 
     bool ok = true;
-    if (l_meta.l) {
+    if (l_meta.q) {
         report(3, "Freeing old queue");
-        ok = do_free(argc, argv);
+        ok = do_free(1, argv);
     }
     error_check();
 
     if (exception_setup(true)) {
-        l_meta.l = q_new();
+        l_meta.ops = backend_get(index);
+        l_meta.q = l_meta.ops->new();
         l_meta.size = 0;
     }
     exception_cancel();
@@ -164,22 +205,27 @@ static void fill_rand_string(char *buf, size_t buf_size)
     buf[len] = '\0';
 }
 
+/* Run the constant time test of an operation in simulation mode */
+static bool simulate(int argc, char *argv[], bool (*is_const)(void))
+{
+    if (argc != 1) {
+        report(1, "%s does not need arguments in simulation mode", argv[0]);
+        return false;
+    }
+    bool ok = is_const();
+    if (!ok) {
+        report(1, "ERROR: Probably not constant time");
+        return false;
+    }
+    report(1, "Probably constant time");
+    return ok;
+}
+
 /* insert head */
 static bool do_ih(int argc, char *argv[])
 {
-    if (simulation) {
-        if (argc != 1) {
-            report(1, "%s does not need arguments in simulation mode", argv[0]);
-            return false;
-        }
-        bool ok = is_insert_head_const();
-        if (!ok) {
-            report(1, "ERROR: Probably not constant time");
-            return false;
-        }
-        report(1, "Probably constant time");
-        return ok;
-    }
+    if (simulation)
+        return simulate(argc, argv, is_insert_head_const);
 
     char *lasts = NULL;
     char randstr_buf[MAX_RANDSTR_LEN];
@@ -203,7 +249,7 @@ static bool do_ih(int argc, char *argv[])
         inserts = randstr_buf;
     }
 
-    if (!l_meta.l)
+    if (!l_meta.q)
         report(3, "Warning: Calling insert head on null queue");
     error_check();
 
@@ -211,12 +257,11 @@ static bool do_ih(int argc, char *argv[])
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand)
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
-            bool rval = q_insert_head(l_meta.l, inserts);
+            bool rval = l_meta.ops->insert_head(l_meta.q, inserts);
             if (rval) {
                 lcnt++;
                 l_meta.size++;
-                char *cur_inserts =
-                    list_entry(l_meta.l->next, element_t, list)->value;
+                char *cur_inserts = l_meta.ops->peek_head(l_meta.q);
                 if (!cur_inserts) {
                     report(1, "ERROR: Failed to save copy of string in queue");
                     ok = false;
@@ -257,19 +302,8 @@ static bool do_ih(int argc, char *argv[])
 /* insert tail */
 static bool do_it(int argc, char *argv[])
 {
-    if (simulation) {
-        if (argc != 1) {
-            report(1, "%s does not need arguments in simulation mode", argv[0]);
-            return false;
-        }
-        bool ok = is_insert_tail_const();
-        if (!ok) {
-            report(1, "ERROR: Probably not constant time");
-            return false;
-        }
-        report(1, "Probably constant time");
-        return ok;
-    }
+    if (simulation)
+        return simulate(argc, argv, is_insert_tail_const);
 
     char randstr_buf[MAX_RANDSTR_LEN];
     int reps = 1;
@@ -292,7 +326,7 @@ static bool do_it(int argc, char *argv[])
         inserts = randstr_buf;
     }
 
-    if (!l_meta.l)
+    if (!l_meta.q)
         report(3, "Warning: Calling insert tail on null queue");
     error_check();
 
@@ -300,12 +334,11 @@ static bool do_it(int argc, char *argv[])
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand)
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
-            bool rval = q_insert_tail(l_meta.l, inserts);
+            bool rval = l_meta.ops->insert_tail(l_meta.q, inserts);
             if (rval) {
                 lcnt++;
                 l_meta.size++;
-                char *cur_inserts =
-                    list_entry(l_meta.l->prev, element_t, list)->value;
+                char *cur_inserts = l_meta.ops->peek_tail(l_meta.q);
                 if (!cur_inserts) {
                     report(1, "ERROR: Failed to save copy of string in queue");
                     ok = false;
@@ -329,6 +362,17 @@ static bool do_it(int argc, char *argv[])
     return ok;
 }
 
+/* Return copy-out buffer of fast remove mode, with room for the canary */
+static char *get_remove_buf(void)
+{
+    if (remove_buf_length != string_length) {
+        free(remove_buf);
+        remove_buf = malloc(string_length + CANARY_LEN + 1);
+        remove_buf_length = remove_buf ? string_length : -1;
+    }
+    return remove_buf;
+}
+
 static bool do_remove(int option, int argc, char *argv[])
 {
     // option 0 is for remove head; option 1 is for remove tail
@@ -338,19 +382,9 @@ static bool do_remove(int option, int argc, char *argv[])
      * out the exact reasons and resolve later.
      */
 #if !defined(__aarch64__)
-    if (simulation) {
-        if (argc != 1) {
-            report(1, "%s does not need arguments in simulation mode", argv[0]);
-            return false;
-        }
-        bool ok = option ? is_remove_tail_const() : is_remove_head_const();
-        if (!ok) {
-            report(1, "ERROR: Probably not constant time");
-            return false;
-        }
-        report(1, "Probably constant time");
-        return ok;
-    }
+    if (simulation)
+        return simulate(argc, argv,
+                        option ? is_remove_tail_const : is_remove_head_const);
 #endif
 
     if (argc != 1 && argc != 2) {
@@ -358,50 +392,39 @@ static bool do_remove(int option, int argc, char *argv[])
         return false;
     }
 
-    char *removes = malloc(string_length + STRINGPAD + 1);
+    int pad = fast_remove ? CANARY_LEN : STRINGPAD;
+    char *removes = fast_remove ? get_remove_buf()
+                                : malloc(string_length + STRINGPAD + 1);
     if (!removes) {
         report(1,
                "INTERNAL ERROR.  Could not allocate space for removed strings");
         return false;
     }
 
-    char *checks = malloc(string_length + 1);
-    if (!checks) {
-        report(1,
-               "INTERNAL ERROR.  Could not allocate space for removed strings");
-        free(removes);
-        return false;
-    }
-
     bool check = argc > 1;
     bool ok = true;
-    if (check) {
-        strncpy(checks, argv[1], string_length + 1);
-        checks[string_length] = '\0';
-    }
 
     removes[0] = '\0';
-    memset(removes + 1, 'X', string_length + STRINGPAD - 1);
-    removes[string_length + STRINGPAD] = '\0';
+    if (fast_remove)
+        memset(removes + string_length + 1, 'X', pad - 1);
+    else
+        memset(removes + 1, 'X', string_length + pad - 1);
+    removes[string_length + pad] = '\0';
 
     if (!l_meta.size)
         report(3, "Warning: Calling remove head on empty queue");
     error_check();
 
-    element_t *re = NULL;
+    bool (*remove)(void *, char *, size_t) =
+        option ? l_meta.ops->remove_tail : l_meta.ops->remove_head;
+    bool is_null = true;
     if (exception_setup(true))
-        re = option ? q_remove_tail(l_meta.l, removes, string_length + 1)
-                    : q_remove_head(l_meta.l, removes, string_length + 1);
+        is_null = !remove(l_meta.q, removes, string_length + 1);
     exception_cancel();
 
-    bool is_null = re ? false : true;
-
     if (!is_null) {
-        // q_remove_head and q_remove_tail are not responsible for releasing
-        // node
-        q_release_element(re);
 
-        removes[string_length + STRINGPAD] = '\0';
+        removes[string_length + pad] = '\0';
         if (removes[0] == '\0') {
             report(1, "ERROR: Failed to store removed value");
             ok = false;
@@ -412,9 +435,9 @@ static bool do_remove(int option, int argc, char *argv[])
          * If there's other character in padding, it's overflowed.
          */
         int i = string_length + 1;
-        while ((i < string_length + STRINGPAD) && (removes[i] == 'X'))
+        while ((i < string_length + pad) && (removes[i] == 'X'))
             i++;
-        if (i != string_length + STRINGPAD) {
+        if (i != string_length + pad) {
             report(1,
                    "ERROR: copying of string in remove_head overflowed "
                    "destination buffer.");
@@ -435,16 +458,17 @@ static bool do_remove(int option, int argc, char *argv[])
         }
     }
 
-    if (ok && check && strcmp(removes, checks)) {
-        report(1, "ERROR: Removed value %s != expected value %s", removes,
-               checks);
+    /* Expected value is compared up to the length of the copy-out buffer */
+    if (ok && check && strncmp(removes, argv[1], string_length)) {
+        report(1, "ERROR: Removed value %s != expected value %.*s", removes,
+               string_length, argv[1]);
         ok = false;
     }
 
     show_queue(3);
 
-    free(removes);
-    free(checks);
+    if (!fast_remove)
+        free(removes);
     return ok && !error_check();
 }
 
@@ -471,16 +495,12 @@ static bool do_rhq(int argc, char *argv[])
         report(3, "Warning: Calling remove head on empty queue");
     error_check();
 
-    element_t *re = NULL;
-
+    bool removed = false;
     if (exception_setup(true))
-        re = q_remove_head(l_meta.l, NULL, 0);
+        removed = l_meta.ops->remove_head(l_meta.q, NULL, 0);
     exception_cancel();
 
-    if (re) {
-        // q_remove_head and q_remove_tail are not responsible for releasing
-        // node
-        q_release_element(re);
+    if (removed) {
 
         report(2, "Removed element from queue");
         lcnt--;
@@ -509,7 +529,7 @@ static bool do_dedup(int argc, char *argv[])
     bool ok = true;
     // set_noallocate_mode(true);
     if (exception_setup(true))
-        ok = q_delete_dup(l_meta.l);
+        ok = l_meta.ops->delete_dup(l_meta.q);
     exception_cancel();
 
     // set_noallocate_mode(false);
@@ -519,20 +539,18 @@ static bool do_dedup(int argc, char *argv[])
         return false;
     }
 
-    element_t *item = NULL;
     if (l_meta.size) {
-        list_for_each_entry (item, l_meta.l, list) {
-            element_t *next_item;
-            if (item->list.next == l_meta.l)
-                break;
-            next_item = list_entry(item->list.next, element_t, list);
-
+        backend_iter_t iter;
+        l_meta.ops->iter_init(l_meta.q, &iter);
+        char *item = l_meta.ops->iter_next(l_meta.q, &iter), *next_item;
+        while ((next_item = l_meta.ops->iter_next(l_meta.q, &iter))) {
             // assume queue has been sorted
-            if (strcmp(item->value, next_item->value) == 0) {
+            if (strcmp(item, next_item) == 0) {
                 report(1, "ERROR: Contain duplicate string on queue");
                 ok = false;
                 break;
             }
+            item = next_item;
         }
     }
     show_queue(3);
@@ -542,18 +560,21 @@ static bool do_dedup(int argc, char *argv[])
 
 static bool do_reverse(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate(argc, argv, is_reverse_const);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
 
-    if (!l_meta.l)
+    if (!l_meta.q)
         report(3, "Warning: Calling reverse on null queue");
     error_check();
 
     set_noallocate_mode(true);
     if (exception_setup(true))
-        q_reverse(l_meta.l);
+        l_meta.ops->reverse(l_meta.q);
     exception_cancel();
 
     set_noallocate_mode(false);
@@ -563,6 +584,9 @@ static bool do_reverse(int argc, char *argv[])
 
 static bool do_size(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate(argc, argv, is_size_const);
+
     if (argc != 1 && argc != 2) {
         report(1, "%s takes 0-1 arguments", argv[0]);
         return false;
@@ -582,13 +606,13 @@ static bool do_size(int argc, char *argv[])
     }
 
     int cnt = 0;
-    if (!l_meta.l)
+    if (!l_meta.q)
         report(3, "Warning: Calling size on null queue");
     error_check();
 
     if (exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
-            cnt = q_size(l_meta.l);
+            cnt = l_meta.ops->size(l_meta.q);
             ok = ok && !error_check();
         }
     }
@@ -612,6 +636,9 @@ static bool do_size(int argc, char *argv[])
 
 bool do_sort(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate(argc, argv, is_sort_const);
+
     // if (argc != 1) {
     //     report(1, "%s takes no arguments", argv[0]);
     //     return false;
@@ -619,42 +646,58 @@ bool do_sort(int argc, char *argv[])
     if (argc > 2)
         report(1, "%s takes <=2 arguments", argv[0]);
 
-    if (!l_meta.l)
+    if (!l_meta.q)
         report(3, "Warning: Calling sort on null queue");
     error_check();
 
-    int cnt = q_size(l_meta.l);
+    int cnt = l_meta.ops->size(l_meta.q);
     if (cnt < 2)
         report(3, "Warning: Calling sort on single node");
     error_check();
 
-    set_noallocate_mode(true);
-    if (exception_setup(true)) {
-        if (argc == 2 && !strcmp(argv[1], "linux")) {
-            q_sort(l_meta.l);
-            // list_sort(NULL, l_meta.l, compare_element_t);
-        } else {
-            // q_sort(l_meta.l);
-            list_sort(NULL, l_meta.l, compare_element_t);
+    bool ok = true;
+    if (l_meta.ops->sort_allocates) {
+        if (exception_setup(true) && !l_meta.ops->sort(l_meta.q)) {
+            fail_count++;
+            if (fail_count < fail_limit) {
+                report(2, "Sort failed");
+            } else {
+                report(1, "ERROR: Sort failed (%d failures total)",
+                       fail_count);
+                ok = false;
+            }
         }
+        exception_cancel();
+    } else {
+        set_noallocate_mode(true);
+        if (exception_setup(true)) {
+            if (l_meta.ops == &list_ops && argc == 2 &&
+                !strcmp(argv[1], "linux")) {
+                q_sort(l_meta.q);
+                // list_sort(NULL, l_meta.l, compare_element_t);
+            } else if (l_meta.q) {
+                // q_sort(l_meta.l);
+                l_meta.ops->sort(l_meta.q);
+            }
+        }
+        exception_cancel();
+        set_noallocate_mode(false);
     }
-    exception_cancel();
-    set_noallocate_mode(false);
 
-    bool ok = true;
-    if (l_meta.size) {
-        for (struct list_head *cur_l = l_meta.l->next;
-             cur_l != l_meta.l && --cnt; cur_l = cur_l->next) {
+    if (ok && l_meta.size) {
+        backend_iter_t iter;
+        l_meta.ops->iter_init(l_meta.q, &iter);
+        char *item = l_meta.ops->iter_next(l_meta.q, &iter), *next_item;
+        while (--cnt > 0 &&
+               (next_item = l_meta.ops->iter_next(l_meta.q, &iter))) {
             /* Ensure each element in ascending order */
             /* FIXME: add an option to specify sorting order */
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
-            if (strcasecmp(item->value, next_item->value) > 0) {
+            if (strcasecmp(item, next_item) > 0) {
                 report(1, "ERROR: Not sorted in ascending order");
                 ok = false;
                 break;
             }
+            item = next_item;
         }
     }
 
@@ -664,18 +707,21 @@ bool do_sort(int argc, char *argv[])
 
 static bool do_dm(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate(argc, argv, is_delete_mid_const);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
 
-    if (!l_meta.l)
+    if (!l_meta.q)
         report(3, "Warning: Try to access null queue");
     error_check();
 
     bool ok = true;
     if (exception_setup(true))
-        ok = q_delete_mid(l_meta.l);
+        ok = l_meta.ops->delete_mid(l_meta.q);
     exception_cancel();
 
     show_queue(3);
@@ -684,18 +730,21 @@ static bool do_dm(int argc, char *argv[])
 
 static bool do_swap(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate(argc, argv, is_swap_const);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
 
-    if (!l_meta.l)
+    if (!l_meta.q)
         report(3, "Warning: Try to access null queue");
     error_check();
 
     set_noallocate_mode(true);
     if (exception_setup(true))
-        q_swap(l_meta.l);
+        l_meta.ops->swap(l_meta.q);
     exception_cancel();
 
     set_noallocate_mode(false);
@@ -704,24 +753,6 @@ static bool do_swap(int argc, char *argv[])
     return !error_check();
 }
 
-static bool is_circular()
-{
-    struct list_head *cur = l_meta.l->next;
-    while (cur != l_meta.l) {
-        if (!cur)
-            return false;
-        cur = cur->next;
-    }
-
-    cur = l_meta.l->prev;
-    while (cur != l_meta.l) {
-        if (!cur)
-            return false;
-        cur = cur->prev;
-    }
-    return true;
-}
-
 static bool show_queue(int vlevel)
 {
     bool ok = true;
@@ -729,28 +760,28 @@ static bool show_queue(int vlevel)
         return true;
 
     int cnt = 0;
-    if (!l_meta.l) {
+    if (!l_meta.q) {
         report(vlevel, "l = NULL");
         return true;
     }
 
-    if (!is_circular()) {
+    if (l_meta.ops->check && !l_meta.ops->check(l_meta.q)) {
         report(vlevel, "ERROR:  Queue is not doubly circular");
         return false;
     }
 
     report_noreturn(vlevel, "l = [");
 
-    struct list_head *ori = l_meta.l;
-    struct list_head *cur = l_meta.l->next;
+    backend_iter_t iter;
+    char *value = NULL;
+    l_meta.ops->iter_init(l_meta.q, &iter);
 
     if (exception_setup(true)) {
-        while (ok && ori != cur && cnt < lcnt) {
-            element_t *e = list_entry(cur, element_t, list);
+        while (ok && (value = l_meta.ops->iter_next(l_meta.q, &iter)) &&
+               cnt < lcnt) {
             if (cnt < big_list_size)
-                report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", e->value);
+                report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", value);
             cnt++;
-            cur = cur->next;
             ok = ok && !error_check();
         }
     }
@@ -761,7 +792,7 @@ static bool show_queue(int vlevel)
         return false;
     }
 
-    if (cur == ori) {
+    if (!value) {
         if (cnt <= big_list_size)
             report(vlevel, "]");
         else
@@ -782,16 +813,1121 @@ static bool do_shuffle(int argc, char *argv[])
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
-    if (!l_meta.l)
+    if (!l_meta.q)
         report(3, "Warning: Calling reverse on null queue");
     error_check();
 
+    bool ok = true;
     if (exception_setup(true))
-        q_shuffle(l_meta.l);
+        ok = l_meta.ops->shuffle(l_meta.q);
     exception_cancel();
 
+    if (!ok)
+        report(1, "ERROR: Could not allocate space to shuffle queue");
     show_queue(3);
-    return true && !error_check();
+    return ok && !error_check();
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Range of queue sizes measured by the complexity command */
+#define COMPLEXITY_MIN 125
+#define COMPLEXITY_MAX 64000
+
+/* Samples taken at each size; their median is kept */
+#define COMPLEXITY_REPS 11
+
+/*
+ * A sample times a batch of calls, doubled until it runs this long or
+ * reaches COMPLEXITY_BATCH_MAX calls.  The cap is the same at every size,
+ * so that inserting or removing elements touches as much memory at each.
+ */
+#define COMPLEXITY_BATCH_NS 200000
+#define COMPLEXITY_BATCH_MAX 32
+
+/*
+ * Calls taking this long are timed one at a time.  Every sample starts with
+ * the queue pushed out of the L2 cache, as a walk over the queue otherwise
+ * speeds up several times when it fits, which would pass for faster growth.
+ */
+#define COMPLEXITY_COLD_NS 1000
+
+/* Such calls run faster per element on smaller queues, so are left out */
+#define COMPLEXITY_COLD_MIN 1000
+
+/* Operations are called through the backend chosen with option backend */
+typedef void (*scaling_function)(const queue_ops_t *ops, void *q);
+
+static void scale_sort(const queue_ops_t *ops, void *q)
+{
+    ops->sort(q);
+}
+
+static void scale_reverse(const queue_ops_t *ops, void *q)
+{
+    ops->reverse(q);
+}
+
+static void scale_size(const queue_ops_t *ops, void *q)
+{
+    ops->size(q);
+}
+
+static void scale_dm(const queue_ops_t *ops, void *q)
+{
+    ops->delete_mid(q);
+}
+
+static void scale_swap(const queue_ops_t *ops, void *q)
+{
+    ops->swap(q);
+}
+
+static void scale_ih(const queue_ops_t *ops, void *q)
+{
+    ops->insert_head(q, "gerbil");
+}
+
+static void scale_it(const queue_ops_t *ops, void *q)
+{
+    ops->insert_tail(q, "gerbil");
+}
+
+static void scale_rh(const queue_ops_t *ops, void *q)
+{
+    ops->remove_head(q, NULL, 0);
+}
+
+static void scale_rt(const queue_ops_t *ops, void *q)
+{
+    ops->remove_tail(q, NULL, 0);
+}
+
+static const struct {
+    char *name;
+    scaling_function operation;
+    /* Calls are not batched, as a second one sees sorted input */
+    bool once;
+} scaling_ops[] = {
+    {"sort", scale_sort, true}, {"reverse", scale_reverse}, {"size", scale_size},
+    {"dm", scale_dm},           {"swap", scale_swap},       {"ih", scale_ih},
+    {"it", scale_it},           {"rh", scale_rh},           {"rt", scale_rt},
+};
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Evict the L2 cache by writing a buffer twice its size */
+static void evict_cache()
+{
+    static char *buf = NULL;
+    static size_t len = 0;
+    if (!buf) {
+        long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        len = 2 * (l2 > 0 ? (size_t) l2 : 2 << 20);
+        if (!(buf = malloc(len)))
+            return;
+    }
+    for (size_t i = 0; i < len; i += 64)
+        buf[i]++;
+}
+
+/*
+ * Time a batch of calls of operation on a private queue of ops of given
+ * size and store the mean time of a call in ns.  A *batch of 0 is
+ * calibrated first.
+ */
+static bool time_scaling(const queue_ops_t *ops,
+                         scaling_function operation,
+                         int size,
+                         int *batch,
+                         double *ns)
+{
+    char randstr_buf[MAX_RANDSTR_LEN];
+    void *q = ops->new();
+    bool ok = q != NULL;
+
+    for (int i = 0; ok && i < size; i++) {
+        fill_rand_string(randstr_buf, sizeof(randstr_buf));
+        ok = ops->insert_tail(q, randstr_buf);
+    }
+    if (!ok) {
+        report(1, "ERROR: Could not build queue of %d elements", size);
+        ops->free(q);
+        return false;
+    }
+
+    /* Keep the cost of the checking allocator independent of size */
+    set_cautious_mode(false);
+    if (exception_setup(true)) {
+        int calls = *batch ? *batch : 1;
+        for (int retry = !*batch; true; retry = 0) {
+            evict_cache();
+            double start = now_ns();
+            for (int i = 0; i < calls; i++)
+                operation(ops, q);
+            *ns = (now_ns() - start) / calls;
+            if (*batch)
+                break;
+            /* While calibrating, a slow single call may be a page fault */
+            if (calls == 1 && *ns >= COMPLEXITY_COLD_NS) {
+                if (retry)
+                    continue;
+                break;
+            }
+            if (*ns * calls >= COMPLEXITY_BATCH_NS ||
+                calls * 2 > COMPLEXITY_BATCH_MAX)
+                break;
+            calls *= 2;
+        }
+        *batch = calls;
+    } else {
+        ok = false;
+    }
+    exception_cancel();
+
+    ops->free(q);
+    set_cautious_mode(true);
+    return ok && !error_check();
+}
+
+static bool do_complexity(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 4) {
+        report(1, "%s needs 1-3 arguments", argv[0]);
+        return false;
+    }
+
+    scaling_function operation = NULL;
+    bool once = false;
+    for (size_t i = 0; i < sizeof(scaling_ops) / sizeof(scaling_ops[0]); i++)
+        if (!strcmp(argv[1], scaling_ops[i].name)) {
+            operation = scaling_ops[i].operation;
+            once = scaling_ops[i].once;
+        }
+    if (!operation) {
+        report(1, "Unknown operation '%s'", argv[1]);
+        return false;
+    }
+
+    int max_n = COMPLEXITY_MAX;
+    if (argc > 2 &&
+        (!get_int(argv[2], &max_n) || max_n < 2 * COMPLEXITY_COLD_MIN)) {
+        report(1, "Invalid maximum size '%s' (at least %d)", argv[2],
+               2 * COMPLEXITY_COLD_MIN);
+        return false;
+    }
+
+    complexity_t expect = O_COUNT;
+    if (argc > 3 && (expect = complexity_parse(argv[3])) == O_COUNT) {
+        report(1, "Unknown model '%s'.  Use one of 1, logn, n, nlogn, n2",
+               argv[3]);
+        return false;
+    }
+
+    /* Geometrically increasing sizes ending at max_n */
+    int cnt = 0;
+    double n[COMPLEXITY_MAX_SAMPLES], t[COMPLEXITY_MAX_SAMPLES];
+    int size = max_n;
+    while (size / 2 >= COMPLEXITY_MIN && cnt < COMPLEXITY_MAX_SAMPLES - 1) {
+        size /= 2;
+        cnt++;
+    }
+
+    const queue_ops_t *ops = backend_get(backend);
+    report(1, "%10s %14s %8s", "n", "time (us)", "batch");
+    int fitted = 0;
+    for (int i = 0; i <= cnt; i++, size *= 2) {
+        int sz = i == cnt ? max_n : size;
+        /* The calibrating run also warms up the allocator */
+        int batch = once ? 1 : 0;
+        double ns[COMPLEXITY_REPS];
+        if (!time_scaling(ops, operation, sz, &batch, &ns[0]))
+            return false;
+        if (batch == 1 && sz < COMPLEXITY_COLD_MIN)
+            continue;
+        for (int r = 0; r < COMPLEXITY_REPS; r++)
+            if (!time_scaling(ops, operation, sz, &batch, &ns[r]))
+                return false;
+        qsort(ns, COMPLEXITY_REPS, sizeof(double), compare_double);
+        n[fitted] = sz;
+        /* Below clock resolution */
+        t[fitted] =
+            ns[COMPLEXITY_REPS / 2] > 0.0 ? ns[COMPLEXITY_REPS / 2] : 1.0;
+        report(1, "%10d %14.3f %8d", sz, t[fitted] / 1e3, batch);
+        fitted++;
+    }
+
+    complexity_fit_t fit;
+    if (!complexity_fit(n, t, fitted, &fit)) {
+        report(1, "ERROR: Not enough samples to estimate complexity");
+        return false;
+    }
+    for (int m = 0; m < O_COUNT; m++)
+        report(2, "%-12s slope %.3f", complexity_name(m), fit.model_slope[m]);
+    report(1, "Best fit: %s (slope %.3f, confidence %.2f)",
+           complexity_name(fit.order), fit.slope, fit.confidence);
+
+    if (expect != O_COUNT && fit.order > expect) {
+        report(1, "ERROR: %s scales as %s, expected at most %s", argv[1],
+               complexity_name(fit.order), complexity_name(expect));
+        return false;
+    }
+    return true;
+}
+
+/* Report percentiles of n latencies in nanoseconds, sorting them */
+static void report_latency(double *ns, size_t n)
+{
+    if (!n)
+        return;
+    qsort(ns, n, sizeof(double), compare_double);
+    report(1, "Latency (us): p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  "
+              "max %.2f",
+           ns[(size_t) (0.5 * (n - 1))] / 1e3,
+           ns[(size_t) (0.9 * (n - 1))] / 1e3,
+           ns[(size_t) (0.99 * (n - 1))] / 1e3,
+           ns[(size_t) (0.999 * (n - 1))] / 1e3, ns[n - 1] / 1e3);
+}
+
+/* Check that worker threads released all blocks allocated beyond blocks */
+static bool check_blocks(size_t blocks)
+{
+    size_t now = allocation_check();
+    if (now <= blocks)
+        return true;
+    report(1, "ERROR: %zu blocks allocated by threads are still allocated",
+           now - blocks);
+    return false;
+}
+
+/*
+ * Block SIGALRM while starting threads, which inherit the mask, so that the
+ * time limit always interrupts this thread, the only one able to catch it.
+ * The previous mask is stored in saved.
+ */
+static void block_alarm(sigset_t *saved)
+{
+    sigset_t alarm;
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarm, saved);
+}
+
+/* Defaults and limits of the mt command */
+#define MT_PRODUCERS 2
+#define MT_CONSUMERS 2
+#define MT_COUNT 100000
+#define MT_CAPACITY 1024
+#define MT_MAX_THREADS 64
+
+/* Element passed through the concurrent queue, tagged for checking */
+typedef struct {
+    element_t e;
+    int id;
+    double t_push;
+} mt_item_t;
+
+static struct {
+    mpmc_t q;
+    int producers;
+    int count; /* Elements per producer */
+    atomic_int producers_done;
+    atomic_uchar *seen; /* Times each element was taken, by id */
+    double *latency;    /* From push to pop, by id */
+    atomic_bool failed; /* Allocation failed in a producer */
+} mt;
+
+static void *mt_producer(void *arg)
+{
+    int p = (int) (intptr_t) arg;
+    char buf[32];
+
+    for (int k = 0; k < mt.count; k++) {
+        mt_item_t *item = test_malloc(sizeof(mt_item_t));
+        snprintf(buf, sizeof(buf), "p%d-%d", p, k);
+        if (!item || !(item->e.value = test_strdup(buf))) {
+            test_free(item);
+            atomic_store(&mt.failed, true);
+            break;
+        }
+        item->id = p * mt.count + k;
+        item->t_push = now_ns();
+        while (!mpmc_push(&mt.q, &item->e))
+            sched_yield();
+    }
+    atomic_fetch_add(&mt.producers_done, 1);
+    return NULL;
+}
+
+static void *mt_consumer(void *arg)
+{
+    (void) arg;
+    while (true) {
+        element_t *e = mpmc_pop(&mt.q);
+        if (!e) {
+            /* Everything pushed is visible once all producers are done */
+            if (atomic_load(&mt.producers_done) == mt.producers &&
+                !(e = mpmc_pop(&mt.q)))
+                break;
+            if (!e) {
+                sched_yield();
+                continue;
+            }
+        }
+        mt_item_t *item = (mt_item_t *) e;
+        mt.latency[item->id] = now_ns() - item->t_push;
+        atomic_fetch_add(&mt.seen[item->id], 1);
+        test_free(e->value);
+        test_free(item);
+    }
+    return NULL;
+}
+
+static bool do_mt(int argc, char *argv[])
+{
+    int producers = MT_PRODUCERS, consumers = MT_CONSUMERS;
+    int count = MT_COUNT;
+    if (argc > 4 || (argc > 1 && !get_int(argv[1], &producers)) ||
+        (argc > 2 && !get_int(argv[2], &consumers)) ||
+        (argc > 3 && !get_int(argv[3], &count))) {
+        report(1, "%s takes 0-3 integer arguments", argv[0]);
+        return false;
+    }
+    if (producers < 1 || consumers < 1 ||
+        producers + consumers > MT_MAX_THREADS || count < 1 ||
+        (long) producers * count > 100000000) {
+        report(1, "Invalid number of threads or elements");
+        return false;
+    }
+
+    size_t total = (size_t) producers * count;
+    mt.producers = producers;
+    mt.count = count;
+    atomic_init(&mt.producers_done, 0);
+    atomic_init(&mt.failed, false);
+    mt.seen = calloc(total, sizeof(atomic_uchar));
+    mt.latency = malloc(total * sizeof(double));
+    if (!mt.seen || !mt.latency || !mpmc_init(&mt.q, MT_CAPACITY)) {
+        report(1, "ERROR: Could not allocate space for %zu elements", total);
+        free(mt.seen);
+        free(mt.latency);
+        return false;
+    }
+
+    size_t blocks = allocation_check();
+    pthread_t threads[MT_MAX_THREADS];
+    int started = 0;
+    bool ok = true;
+    sigset_t mask;
+    block_alarm(&mask);
+    double start = now_ns();
+    for (int i = 0; ok && i < consumers; i++) {
+        ok = !pthread_create(&threads[started], NULL, mt_consumer, NULL);
+        started += ok;
+    }
+    for (int i = 0; ok && i < producers; i++) {
+        ok = !pthread_create(&threads[started], NULL, mt_producer,
+                             (void *) (intptr_t) i);
+        started += ok;
+    }
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+    if (!ok) {
+        /* Consumers leave once the missing producers count as done */
+        atomic_store(&mt.producers_done, producers);
+        report(1, "ERROR: Could not start thread");
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    double elapsed = now_ns() - start;
+
+    size_t lost = 0, duplicated = 0, taken = 0;
+    for (size_t id = 0; id < total; id++) {
+        if (!mt.seen[id])
+            lost++;
+        else
+            mt.latency[taken++] = mt.latency[id];
+        if (mt.seen[id] > 1)
+            duplicated++;
+    }
+
+    report(1, "%d producers, %d consumers: %zu elements in %.1f ms, "
+              "%.2f Mops/s",
+           producers, consumers, taken, elapsed / 1e6, taken / elapsed * 1e3);
+    report_latency(mt.latency, taken);
+    if (atomic_load(&mt.failed)) {
+        report(1, "ERROR: Could not allocate element");
+        ok = false;
+    } else if (ok && (lost || duplicated)) {
+        report(1, "ERROR: %zu elements lost, %zu duplicated", lost,
+               duplicated);
+        ok = false;
+    }
+
+    /* Left behind only if threads failed to start */
+    element_t *e;
+    while ((e = mpmc_pop(&mt.q))) {
+        test_free(e->value);
+        test_free(e);
+    }
+    ok = check_blocks(blocks) && ok;
+
+    mpmc_destroy(&mt.q);
+    free(mt.seen);
+    free(mt.latency);
+    return ok;
+}
+
+/* Defaults and limits of the steal command */
+#define WS_DEPTH 12
+#define WS_ROOTS 16
+#define WS_CAPACITY 64
+#define WS_WORK 64 /* Hashing rounds per task */
+
+/*
+ * Task of a fork-join computation: a forest of WS_ROOTS complete binary
+ * trees in which every task of depth d > 0 spawns two of depth d - 1.
+ * Tasks are numbered heap-wise within their tree, for checking.
+ */
+typedef struct {
+    element_t e;
+    long id;
+    int depth;
+} ws_task_t;
+
+typedef struct {
+    wsdeque_t d;
+    unsigned int seed;
+    long popped, stolen, aborted, missed; /* Written by owner only */
+    unsigned long sink;
+} ws_worker_t;
+
+static struct {
+    ws_worker_t *workers;
+    int n;
+    long tree; /* Tasks per tree */
+    atomic_long remaining;
+    atomic_uchar *seen; /* Times each task was run, by id */
+    atomic_bool failed; /* Allocation failed in a worker */
+} ws;
+
+static ws_task_t *ws_task(long id, int depth)
+{
+    char buf[32];
+    ws_task_t *t = test_malloc(sizeof(ws_task_t));
+    snprintf(buf, sizeof(buf), "t%ld", id);
+    if (!t || !(t->e.value = test_strdup(buf))) {
+        test_free(t);
+        return NULL;
+    }
+    t->id = id;
+    t->depth = depth;
+    return t;
+}
+
+/* Spawn child of depth d, or give up on its 2^(d+1) - 1 tasks */
+static void ws_spawn(ws_worker_t *w, long id, int depth)
+{
+    ws_task_t *t = ws_task(id, depth);
+    if (t && ws_push(&w->d, &t->e))
+        return;
+    if (t) {
+        test_free(t->e.value);
+        test_free(t);
+    }
+    atomic_store(&ws.failed, true);
+    atomic_fetch_sub(&ws.remaining, (2L << depth) - 1);
+}
+
+static void ws_run(ws_worker_t *w, ws_task_t *t)
+{
+    /* Stand-in for real work: FNV-1a over the value */
+    unsigned long h = 14695981039346656037UL;
+    for (int r = 0; r < WS_WORK; r++)
+        for (const char *c = t->e.value; *c; c++)
+            h = (h ^ (unsigned char) *c) * 1099511628211UL;
+    w->sink += h;
+
+    atomic_fetch_add(&ws.seen[t->id], 1);
+    if (t->depth > 0) {
+        long root = t->id / ws.tree * ws.tree, local = t->id % ws.tree;
+        ws_spawn(w, root + 2 * local + 1, t->depth - 1);
+        ws_spawn(w, root + 2 * local + 2, t->depth - 1);
+    }
+    test_free(t->e.value);
+    test_free(t);
+    atomic_fetch_sub(&ws.remaining, 1);
+}
+
+static element_t *ws_take(ws_worker_t *w)
+{
+    element_t *e = ws_pop(&w->d);
+    if (e) {
+        w->popped++;
+        return e;
+    }
+    if (ws.n == 1)
+        return NULL;
+
+    /* Out of work: try one victim picked at random */
+    int victim = rand_r(&w->seed) % (ws.n - 1);
+    if (victim >= w - ws.workers)
+        victim++;
+    switch (ws_steal(&ws.workers[victim].d, &e)) {
+    case WS_STOLEN:
+        w->stolen++;
+        return e;
+    case WS_ABORT:
+        w->aborted++;
+        break;
+    case WS_EMPTY:
+        w->missed++;
+        break;
+    }
+    return NULL;
+}
+
+static void *ws_worker(void *arg)
+{
+    ws_worker_t *w = arg;
+    while (atomic_load_explicit(&ws.remaining, memory_order_relaxed) > 0) {
+        element_t *e = ws_take(w);
+        if (e)
+            ws_run(w, (ws_task_t *) e);
+        else
+            sched_yield();
+    }
+    return NULL;
+}
+
+/* Run the forest on n workers, all roots pushed to worker 0 */
+static bool ws_round(int n, int depth, double *elapsed)
+{
+    long total = WS_ROOTS * ws.tree;
+    ws.n = n;
+    atomic_init(&ws.remaining, total);
+    atomic_init(&ws.failed, false);
+    memset(ws.seen, 0, total * sizeof(atomic_uchar));
+    int ready = 0;
+    for (; ready < n; ready++) {
+        ws_worker_t *w = &ws.workers[ready];
+        memset(w, 0, sizeof(ws_worker_t));
+        w->seed = ready + 1;
+        if (!ws_init(&w->d, WS_CAPACITY))
+            break;
+    }
+
+    bool ok = ready == n;
+    for (int r = 0; ok && r < WS_ROOTS; r++) {
+        ws_task_t *t = ws_task(r * ws.tree, depth);
+        ok = t && ws_push(&ws.workers[0].d, &t->e);
+        if (!ok && t) {
+            test_free(t->e.value);
+            test_free(t);
+        }
+    }
+    if (!ok)
+        atomic_store(&ws.failed, true);
+
+    pthread_t threads[MT_MAX_THREADS];
+    int started = 0;
+    sigset_t mask;
+    block_alarm(&mask);
+    double start = now_ns();
+    for (int i = 0; ok && i < n; i++) {
+        ok = !pthread_create(&threads[started], NULL, ws_worker,
+                             &ws.workers[i]);
+        started += ok;
+    }
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+    if (!ok)
+        report(1, "ERROR: Could not start %d workers", n);
+    if (!ok) {
+        /* Workers left stop at once, their tasks are drained below */
+        atomic_store(&ws.remaining, 0);
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    *elapsed = now_ns() - start;
+
+    for (int i = 0; i < ready; i++) {
+        element_t *e;
+        while ((e = ws_pop(&ws.workers[i].d))) {
+            test_free(e->value);
+            test_free(e);
+        }
+        ws_destroy(&ws.workers[i].d);
+    }
+    return ok;
+}
+
+static bool do_steal(int argc, char *argv[])
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cpus > 1 ? (int) cpus : 1;
+    int depth = WS_DEPTH;
+    if (argc > 3 || (argc > 1 && !get_int(argv[1], &workers)) ||
+        (argc > 2 && !get_int(argv[2], &depth))) {
+        report(1, "%s takes 0-2 integer arguments", argv[0]);
+        return false;
+    }
+    if (workers < 1 || workers > MT_MAX_THREADS || depth < 0 || depth > 20) {
+        report(1, "Invalid number of workers or depth");
+        return false;
+    }
+
+    ws.tree = (2L << depth) - 1;
+    long total = WS_ROOTS * ws.tree;
+    ws.workers = calloc(workers, sizeof(ws_worker_t));
+    ws.seen = malloc(total * sizeof(atomic_uchar));
+    if (!ws.workers || !ws.seen) {
+        report(1, "ERROR: Could not allocate space for %ld tasks", total);
+        free(ws.workers);
+        free(ws.seen);
+        return false;
+    }
+
+    report(1, "%ld tasks, %d per tree", total, (int) ws.tree);
+    size_t blocks = allocation_check();
+    bool ok = true;
+    double base = 0;
+    for (int n = 1; ok && n <= workers; n++) {
+        double elapsed;
+        ok = ws_round(n, depth, &elapsed);
+
+        long popped = 0, stolen = 0, attempts = 0;
+        for (int i = 0; i < n; i++) {
+            ws_worker_t *w = &ws.workers[i];
+            popped += w->popped;
+            stolen += w->stolen;
+            attempts += w->stolen + w->aborted + w->missed;
+        }
+        long lost = 0, duplicated = 0;
+        for (long id = 0; id < total; id++) {
+            lost += !ws.seen[id];
+            duplicated += ws.seen[id] > 1;
+        }
+        if (n == 1)
+            base = elapsed;
+
+        report(1, "%2d workers: %8.1f ms  %6.2f Mtasks/s  speedup %5.2f  "
+                  "stolen %5.2f%%  steals won %5.1f%% of %ld",
+               n, elapsed / 1e6, (popped + stolen) / elapsed * 1e3,
+               base / elapsed, 100.0 * stolen / total,
+               attempts ? 100.0 * stolen / attempts : 0.0, attempts);
+        if (atomic_load(&ws.failed)) {
+            report(1, "ERROR: Could not allocate task");
+            ok = false;
+        } else if (ok && (lost || duplicated)) {
+            report(1, "ERROR: %ld tasks lost, %ld duplicated", lost,
+                   duplicated);
+            ok = false;
+        }
+    }
+    ok = check_blocks(blocks) && ok;
+
+    free(ws.workers);
+    free(ws.seen);
+    return ok;
+}
+
+/* Defaults and limits of the shm command */
+#define SHM_PRODUCERS 1
+#define SHM_COUNT 100000
+#define SHM_LEN 64
+#define SHM_MIN_LEN 40 /* Room for producer, number and time stamp */
+#define SHM_MAX_LEN 4096
+#define SHM_CAPACITY 1024
+#define SHM_MAX_PRODUCERS 16
+#define SHM_POLL_US 1000 /* Interval of checks on children */
+
+/* Results of the consumer process, in memory shared with qtest */
+typedef struct {
+    double start, end;
+    size_t received, misordered;
+    double latency[]; /* From insert to removal, in order of arrival */
+} shm_stats_t;
+
+/* Messages read "producer number time" and are padded to length len */
+static void shm_producer(const char *name, int p, int count, int len)
+{
+    shmq_t *q = shmq_open(name);
+    if (!q)
+        _exit(1);
+
+    char buf[SHM_MAX_LEN + 1];
+    memset(buf, '.', len);
+    buf[len] = '\0';
+    for (int k = 0; k < count; k++) {
+        int n = snprintf(buf, len, "%d %d %.0f", p, k, now_ns());
+        buf[n] = ' ';
+        while (!shmq_insert_tail(q, buf))
+            sched_yield();
+    }
+    shmq_close(q);
+    _exit(0);
+}
+
+static void shm_consumer(const char *name,
+                         shm_stats_t *stats,
+                         int producers,
+                         int count)
+{
+    shmq_t *q = shmq_open(name);
+    int *next = calloc(producers, sizeof(int));
+    if (!q || !next)
+        _exit(1);
+
+    size_t total = (size_t) producers * count;
+    while (stats->received < total) {
+        const char *s = shmq_head(q, NULL);
+        if (!s) {
+            sched_yield();
+            continue;
+        }
+
+        /* Parsed in place, the slot being released only afterwards */
+        double t = now_ns();
+        char *end;
+        long p = strtol(s, &end, 10);
+        long k = strtol(end, &end, 10);
+        double t_insert = strtod(end, NULL);
+        if (p < 0 || p >= producers || k != next[p]++)
+            stats->misordered++;
+        stats->latency[stats->received++] = t - t_insert;
+        shmq_remove_head(q, NULL, 0);
+    }
+    stats->end = now_ns();
+    shmq_close(q);
+    _exit(0);
+}
+
+static bool do_shm(int argc, char *argv[])
+{
+    int producers = SHM_PRODUCERS, count = SHM_COUNT, len = SHM_LEN;
+    if (argc > 4 || (argc > 1 && !get_int(argv[1], &producers)) ||
+        (argc > 2 && !get_int(argv[2], &count)) ||
+        (argc > 3 && !get_int(argv[3], &len))) {
+        report(1, "%s takes 0-3 integer arguments", argv[0]);
+        return false;
+    }
+    if (producers < 1 || producers > SHM_MAX_PRODUCERS || count < 1 ||
+        (long) producers * count > 10000000 || len < SHM_MIN_LEN ||
+        len > SHM_MAX_LEN) {
+        report(1, "Invalid number of producers or messages, or length "
+                  "not within %d-%d",
+               SHM_MIN_LEN, SHM_MAX_LEN);
+        return false;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "/qtest-shm-%d", (int) getpid());
+    size_t total = (size_t) producers * count;
+    size_t stats_size = sizeof(shm_stats_t) + total * sizeof(double);
+    shm_stats_t *stats = mmap(NULL, stats_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    shmq_t *q = shmq_create(name, SHM_CAPACITY, len);
+    if (stats == MAP_FAILED || !q) {
+        report(1, "ERROR: Could not create shared memory for %zu messages",
+               total);
+        if (stats != MAP_FAILED)
+            munmap(stats, stats_size);
+        if (q) {
+            shmq_close(q);
+            shmq_unlink(name);
+        }
+        return false;
+    }
+
+    /* Children would flush what is buffered again */
+    fflush(NULL);
+    pid_t pids[SHM_MAX_PRODUCERS + 1];
+    int started = 0;
+    bool ok = true;
+    stats->start = now_ns();
+    for (int i = 0; ok && i <= producers; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (i == 0)
+                shm_consumer(name, stats, producers, count);
+            shm_producer(name, i - 1, count, len);
+        }
+        ok = pid > 0;
+        if (ok)
+            pids[started++] = pid;
+    }
+    if (!ok)
+        report(1, "ERROR: Could not fork");
+
+    /*
+     * The consumer waits for messages forever if a producer is missing, and
+     * producers retry forever once the queue is full if the consumer is
+     * gone, so children are polled and the rest are killed on any failure.
+     */
+    bool exited[SHM_MAX_PRODUCERS + 1] = {false};
+    int running = started;
+    while (running) {
+        bool reaped = false;
+        for (int i = 0; i < started; i++) {
+            int status;
+            pid_t pid = exited[i] ? 0 : waitpid(pids[i], &status, WNOHANG);
+            if (!pid || (pid < 0 && errno == EINTR))
+                continue;
+            exited[i] = reaped = true;
+            running--;
+            if (pid > 0 && WIFEXITED(status) && !WEXITSTATUS(status))
+                continue;
+            if (ok && i == 0)
+                report(1, "ERROR: Consumer failed");
+            else if (ok)
+                report(1, "ERROR: Producer %d failed", i - 1);
+            ok = false;
+        }
+        if (!ok) {
+            for (int i = 0; i < started; i++) {
+                if (!exited[i]) {
+                    kill(pids[i], SIGKILL);
+                    waitpid(pids[i], NULL, 0);
+                }
+            }
+            break;
+        }
+        if (!reaped)
+            usleep(SHM_POLL_US);
+    }
+
+    if (ok) {
+        double elapsed = stats->end - stats->start;
+        report(1, "%d producers, 1 consumer: %zu messages of %d bytes in "
+                  "%.1f ms, %.2f Mmsgs/s, %.1f MB/s",
+               producers, stats->received, len, elapsed / 1e6,
+               stats->received / elapsed * 1e3,
+               stats->received * (double) len / elapsed * 1e3);
+        report_latency(stats->latency, stats->received);
+        if (stats->misordered) {
+            report(1, "ERROR: %zu messages out of order", stats->misordered);
+            ok = false;
+        }
+    }
+
+    shmq_close(q);
+    shmq_unlink(name);
+    munmap(stats, stats_size);
+    return ok;
+}
+
+static void show_pq(int vlevel)
+{
+    if (!prio)
+        report(vlevel, "pq = NULL");
+    else if (!prio->size)
+        report(vlevel, "pq = []");
+    else
+        report(vlevel, "pq = [%s ...] with %zu elements", pq_peek(prio),
+               pq_size(prio));
+}
+
+/* Free priority queue and check that all its blocks were released */
+static bool pq_release()
+{
+    size_t bcnt = allocation_check() - pq_blocks(prio);
+    error_check();
+    if (exception_setup(true))
+        pq_free(prio);
+    exception_cancel();
+    prio = NULL;
+
+    size_t left = allocation_check();
+    if (left > bcnt) {
+        report(1,
+               "ERROR: Freed priority queue, but %zu blocks are still "
+               "allocated",
+               left - bcnt);
+        return false;
+    }
+    return !error_check();
+}
+
+static bool pq_cmd_new(int argc, char *argv[])
+{
+    bool max = argc == 3 && !strcmp(argv[2], "max");
+    if (argc > 3 || (argc == 3 && !max && strcmp(argv[2], "min"))) {
+        report(1, "%s new takes an optional argument min or max", argv[0]);
+        return false;
+    }
+
+    bool ok = true;
+    if (prio) {
+        report(3, "Freeing old priority queue");
+        ok = pq_release();
+    }
+    error_check();
+    if (exception_setup(true))
+        prio = pq_new(max);
+    exception_cancel();
+    if (!prio) {
+        report(1, "ERROR: Could not allocate priority queue");
+        ok = false;
+    }
+    show_pq(3);
+    return ok && !error_check();
+}
+
+static bool pq_cmd_push(int argc, char *argv[])
+{
+    char randstr_buf[MAX_RANDSTR_LEN];
+    int reps = 1;
+    bool ok = true;
+    if (argc != 3 && argc != 4) {
+        report(1, "%s push needs 1-2 arguments", argv[0]);
+        return false;
+    }
+    if (argc == 4 && !get_int(argv[3], &reps)) {
+        report(1, "Invalid number of insertions '%s'", argv[3]);
+        return false;
+    }
+
+    char *inserts = argv[2];
+    bool need_rand = !strcmp(inserts, "RAND");
+    if (need_rand)
+        inserts = randstr_buf;
+    if (!prio)
+        report(3, "Warning: Calling push on null priority queue");
+    error_check();
+
+    if (exception_setup(true)) {
+        for (int r = 0; ok && r < reps; r++) {
+            if (need_rand)
+                fill_rand_string(randstr_buf, sizeof(randstr_buf));
+            if (!pq_push(prio, inserts)) {
+                fail_count++;
+                if (fail_count < fail_limit) {
+                    report(2, "Insertion of %s failed", inserts);
+                } else {
+                    report(1,
+                           "ERROR: Insertion of %s failed (%d failures total)",
+                           inserts, fail_count);
+                    ok = false;
+                }
+            }
+            ok = ok && !error_check();
+        }
+    }
+    exception_cancel();
+
+    show_pq(3);
+    return ok;
+}
+
+static bool pq_cmd_pop(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3) {
+        report(1, "%s pop needs 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    char *removes = malloc(string_length + 1);
+    if (!removes) {
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for removed strings");
+        return false;
+    }
+    removes[0] = '\0';
+
+    bool ok = true;
+    if (!pq_size(prio))
+        report(3, "Warning: Calling pop on empty priority queue");
+    error_check();
+
+    element_t *e = NULL;
+    if (exception_setup(true)) {
+        e = pq_pop(prio, removes, string_length + 1);
+        if (e)
+            q_release_element(e);
+    }
+    exception_cancel();
+
+    if (e) {
+        report(2, "Removed %s from priority queue", removes);
+    } else {
+        fail_count++;
+        if (argc == 2 && fail_count < fail_limit) {
+            report(2, "Removal from priority queue failed");
+        } else {
+            report(1,
+                   "ERROR: Removal from priority queue failed (%d failures "
+                   "total)",
+                   fail_count);
+            ok = false;
+        }
+    }
+
+    if (ok && argc == 3 && strncmp(removes, argv[2], string_length)) {
+        report(1, "ERROR: Removed value %s != expected value %.*s", removes,
+               string_length, argv[2]);
+        ok = false;
+    }
+
+    show_pq(3);
+    free(removes);
+    return ok && !error_check();
+}
+
+static bool pq_cmd_peek(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s peek takes no arguments", argv[0]);
+        return false;
+    }
+
+    const char *top = pq_peek(prio);
+    if (!top) {
+        report(1, "Priority queue is %s", prio ? "empty" : "NULL");
+        return false;
+    }
+    report(1, "%s", top);
+    return true;
+}
+
+static bool pq_cmd_free(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s free takes no arguments", argv[0]);
+        return false;
+    }
+
+    if (!prio)
+        report(3, "Warning: Calling free on null priority queue");
+    bool ok = pq_release();
+    show_pq(3);
+    return ok;
+}
+
+static bool do_pq(int argc, char *argv[])
+{
+    static const struct {
+        const char *name;
+        bool (*run)(int, char **);
+    } subcommands[] = {
+        {"new", pq_cmd_new},   {"push", pq_cmd_push}, {"pop", pq_cmd_pop},
+        {"peek", pq_cmd_peek}, {"free", pq_cmd_free},
+    };
+
+    size_t n = sizeof(subcommands) / sizeof(subcommands[0]);
+    for (size_t i = 0; argc > 1 && i < n; i++)
+        if (!strcmp(argv[1], subcommands[i].name))
+            return subcommands[i].run(argc, argv);
+
+    report(1, "%s needs one of new, push, pop, peek or free", argv[0]);
+    return false;
 }
 
 static bool do_show(int argc, char *argv[])
@@ -804,9 +1940,20 @@ static bool do_show(int argc, char *argv[])
 }
 
 
+static void set_clock(int oldval)
+{
+    if (!cpucycles_supported(cpucycles_backend)) {
+        report(1, "Cycle counter %d is not supported on this machine",
+               cpucycles_backend);
+        cpucycles_backend = oldval;
+    }
+}
+
 static void console_init()
 {
-    ADD_COMMAND(new, "                | Create new queue");
+    ADD_COMMAND(new,
+                " [backend]      | Create new queue, implemented by backend "
+                "(list, unrolled, ring) if given");
     ADD_COMMAND(free, "                | Delete queue");
     ADD_COMMAND(
         ih,
@@ -839,12 +1986,40 @@ static void console_init()
                 "                | Swap every two adjacent nodes in queue");
     ADD_COMMAND(shuffle, "                | Shuffle the whole queue");
     ADD_COMMAND(hello, "                | Print hello message");
+    ADD_COMMAND(mt,
+                " [p] [c] [n]    | Pass n elements from each of p producer "
+                "threads to c consumer threads through a lock-free queue");
+    ADD_COMMAND(steal,
+                " [w] [d]        | Run a fork-join task tree of depth d on 1 "
+                "to w work-stealing threads");
+    ADD_COMMAND(shm,
+                " [p] [n] [len]  | Pass n messages of len bytes from each of "
+                "p producer processes to a consumer through shared memory");
+    ADD_COMMAND(pq,
+                " op [args]      | Priority queue: new [min|max], push str "
+                "[n], pop [str], peek, free");
+    ADD_COMMAND(complexity,
+                " op [n] [model] | Estimate complexity of op (sort, reverse, "
+                "size, dm, swap, ih, it, rh, rt) over sizes up to n. "
+                "Fail if worse than model (1, logn, n, nlogn, n2)");
     add_param("length", &string_length, "Maximum length of displayed string",
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
               NULL);
     add_param("fail", &fail_limit,
               "Number of times allow queue operations to return false", NULL);
+    add_param("fastremove", &fast_remove,
+              "Reuse copy-out buffer of remove and only check a canary for "
+              "overrun",
+              NULL);
+    add_param("clock", &cpucycles_backend,
+              "Cycle counter of simulation (0: plain, 1: fenced, 2: rdtscp)",
+              set_clock);
+    add_named_param("backend", &backend, backend_names,
+                    "Implementation of queue created by new", NULL);
+    add_param("lazyreverse", &lazy_reverse,
+              "Make reverse flip the orientation of queue in constant time",
+              NULL);
 }
 
 /* Signal handlers */
@@ -864,10 +2039,17 @@ static void sigalrmhandler(int sig)
         "code is too inefficient");
 }
 
+/* Size of current queue, -1 if there is none */
+static int queue_size_probe(void)
+{
+    return l_meta.q ? l_meta.size : -1;
+}
+
 static void queue_init()
 {
     fail_count = 0;
-    l_meta.l = NULL;
+    l_meta.q = NULL;
+    l_meta.ops = &list_ops;
     signal(SIGSEGV, sigsegvhandler);
     signal(SIGALRM, sigalrmhandler);
 }
@@ -879,10 +2061,17 @@ static bool queue_quit(int argc, char *argv[])
         set_cautious_mode(false);
 
     if (exception_setup(true))
-        q_free(l_meta.l);
+        l_meta.ops->free(l_meta.q);
     exception_cancel();
     set_cautious_mode(true);
 
+    free(remove_buf);
+    remove_buf = NULL;
+    remove_buf_length = -1;
+
+    if (prio && !pq_release())
+        return false;
+
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
         report(1, "ERROR: Freed queue, but %lu blocks are still allocated",
@@ -895,11 +2084,12 @@ static bool queue_quit(int argc, char *argv[])
 
 static void usage(char *cmd)
 {
-    printf("Usage: %s [-h] [-f IFILE][-v VLEVEL][-l LFILE]\n", cmd);
+    printf("Usage: %s [-h] [-f IFILE][-v VLEVEL][-l LFILE][-r RFILE]\n", cmd);
     printf("\t-h         Print this information\n");
     printf("\t-f IFILE   Read commands from IFILE\n");
     printf("\t-v VLEVEL  Set verbosity level\n");
     printf("\t-l LFILE   Echo results to LFILE\n");
+    printf("\t-r RFILE   Record commands with outcome and time to RFILE\n");
     exit(0);
 }
 
@@ -948,10 +2138,11 @@ int main(int argc, char *argv[])
     char *infile_name = NULL;
     char lbuf[BUFSIZE];
     char *logfile_name = NULL;
+    char *recfile_name = NULL;
     int level = 4;
     int c;
 
-    while ((c = getopt(argc, argv, "hv:f:l:")) != -1) {
+    while ((c = getopt(argc, argv, "hv:f:l:r:")) != -1) {
         switch (c) {
         case 'h':
             usage(argv[0]);
@@ -976,6 +2167,9 @@ int main(int argc, char *argv[])
             buf[BUFSIZE - 1] = '\0';
             logfile_name = lbuf;
             break;
+        case 'r':
+            recfile_name = optarg;
+            break;
         default:
             printf("Unknown option '%c'\n", c);
             usage(argv[0]);
@@ -999,8 +2193,13 @@ int main(int argc, char *argv[])
     }
     if (logfile_name)
         set_logfile(logfile_name);
+    if (recfile_name && !record_open(recfile_name)) {
+        fprintf(stderr, "Could not open record file '%s'\n", recfile_name);
+        exit(EXIT_FAILURE);
+    }
 
     add_quit_helper(queue_quit);
+    set_record_probe(queue_size_probe);
 
     bool ok = true;
     ok = ok && run_console(infile_name);
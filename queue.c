@@ -5,6 +5,7 @@
 #include <time.h>
 
 #include "harness.h"
+#include "lazy.h"
 #include "queue.h"
 
 /* Notice: sometimes, Cppcheck would find the potential NULL pointer bugs,
@@ -19,17 +20,70 @@ struct list_head *find_mid(struct list_head *);
 struct list_head *cut_list(struct list_head *);
 struct list_head *mergeTwoLists(struct list_head *, struct list_head *);
 
+/*
+ * Queue head allocated by q_new.  With lazy reversal enabled, q_reverse only
+ * flips the orientation bit, and the logical head of the queue is then the
+ * tail of the underlying list.  The list_head comes first so that a queue is
+ * still freed through its struct list_head pointer.
+ */
+typedef struct {
+    struct list_head head;
+    bool reversed;
+} queue_head_t;
+
+#define to_queue(h) container_of(h, queue_head_t, head)
+
+int lazy_reverse = 0;
+
+bool q_reversed(struct list_head *head)
+{
+    return head && to_queue(head)->reversed;
+}
+
+void q_set_reversed(struct list_head *head, bool reversed)
+{
+    if (head)
+        to_queue(head)->reversed = reversed;
+}
+
+static void reverse_list(struct list_head *head)
+{
+    if (list_empty(head) || list_is_singular(head))
+        return;
+
+    // use list_move
+    struct list_head *tail = head;
+    while (tail->next != head) {
+        list_move(head->prev, tail);
+        tail = tail->next;
+    }
+}
+
+/*
+ * Apply a pending reversal to the list itself, so that list order matches
+ * queue order.  Required before walking the list directly.
+ */
+void q_normalize(struct list_head *head)
+{
+    if (!q_reversed(head))
+        return;
+    reverse_list(head);
+    to_queue(head)->reversed = false;
+}
+
 /*
  * Create empty queue.
  * Return NULL if could not allocate space.
  */
 struct list_head *q_new()
 {
-    struct list_head *new = malloc(sizeof(struct list_head));
-    if (new) {
-        INIT_LIST_HEAD(new);
-    }
-    return new;
+    queue_head_t *q = malloc(sizeof(queue_head_t));
+    if (!q)
+        return NULL;
+
+    INIT_LIST_HEAD(&q->head);
+    q->reversed = false;
+    return &q->head;
 }
 
 /* Free all storage used by queue */
@@ -77,7 +131,10 @@ bool q_insert_head(struct list_head *head, char *s)
     strncpy(new_ele->value, s, len);
     new_ele->value[len] = '\0';
 
-    list_add(&new_ele->list, head);
+    if (q_reversed(head))
+        list_add_tail(&new_ele->list, head);
+    else
+        list_add(&new_ele->list, head);
     return true;
 }
 
@@ -111,7 +168,10 @@ bool q_insert_tail(struct list_head *head, char *s)
     strncpy(new_ele->value, s, len);
     new_ele->value[len] = '\0';
 
-    list_add_tail(&new_ele->list, head);
+    if (q_reversed(head))
+        list_add(&new_ele->list, head);
+    else
+        list_add_tail(&new_ele->list, head);
     return true;
 }
 
@@ -134,12 +194,14 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
     if (!head || list_empty(head))
         return NULL;
 
-    element_t *node = list_first_entry(head, element_t, list);
+    element_t *node = list_entry(q_reversed(head) ? head->prev : head->next,
+                                 element_t, list);
     list_del(&node->list);
 
-    if (sp != NULL && bufsize > 1) {
-        strncpy(sp, node->value, bufsize - 1);
-        sp[bufsize - 1] = '\0';
+    if (sp != NULL && bufsize) {
+        size_t len = strnlen(node->value, bufsize - 1);
+        memcpy(sp, node->value, len);
+        sp[len] = '\0';
     }
 
     return node;
@@ -154,12 +216,14 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
     if (!head || list_empty(head))
         return NULL;
 
-    element_t *node = list_entry(head->prev, element_t, list);
+    element_t *node = list_entry(q_reversed(head) ? head->next : head->prev,
+                                 element_t, list);
     list_del(&node->list);
 
     if (sp != NULL && bufsize) {
-        strncpy(sp, node->value, bufsize - 1);
-        sp[bufsize - 1] = '\0';
+        size_t len = strnlen(node->value, bufsize - 1);
+        memcpy(sp, node->value, len);
+        sp[len] = '\0';
     }
 
     return node;
@@ -210,10 +274,20 @@ bool q_delete_mid(struct list_head *head)
     // Use fast and slow pointer technique
     // pointer of pointer is to prevent using another pointer to record the
     // previous node
-    struct list_head *mid = head->next;
-    for (struct list_head *fast = head->next;
-         fast != head && fast->next != head; fast = fast->next->next) {
-        mid = mid->next;
+    struct list_head *mid;
+    if (q_reversed(head)) {
+        // walk from the logical head, which is the tail of the list
+        mid = head->prev;
+        for (struct list_head *fast = head->prev;
+             fast != head && fast->prev != head; fast = fast->prev->prev) {
+            mid = mid->prev;
+        }
+    } else {
+        mid = head->next;
+        for (struct list_head *fast = head->next;
+             fast != head && fast->next != head; fast = fast->next->next) {
+            mid = mid->next;
+        }
     }
     //"indir" is the middle list_node, we want to delete this element_t
     list_del(mid);
@@ -294,6 +368,8 @@ void q_swap(struct list_head *head)
     // https://leetcode.com/problems/swap-nodes-in-pairs/
     if (!head || list_empty(head) || list_is_singular(head))
         return;
+    // pairs are formed from the logical head
+    q_normalize(head);
 
     // Dealing with element_t or list_head is complicated
     // So i decide to swap the value in element_t
@@ -313,19 +389,17 @@ void q_swap(struct list_head *head)
  * This function should not allocate or free any list elements
  * (e.g., by calling q_insert_head, q_insert_tail, or q_remove_head).
  * It should rearrange the existing ones.
+ * With lazy_reverse set, only the orientation bit of the queue is flipped.
  */
 void q_reverse(struct list_head *head)
 {
-    if (!head || list_empty(head) || list_is_singular(head))
+    if (!head)
         return;
 
-    // use list_move
-    struct list_head *tail = head;
-    while (tail->next != head) {
-        list_move(head->prev, tail);
-        tail = tail->next;
-    }
-    return;
+    if (lazy_reverse)
+        to_queue(head)->reversed = !to_queue(head)->reversed;
+    else
+        reverse_list(head);
 }
 
 /*
@@ -335,6 +409,8 @@ void q_reverse(struct list_head *head)
  */
 void q_sort(struct list_head *head)
 {
+    // the order before sorting does not matter
+    q_set_reversed(head, false);
     if (!head || list_empty(head) || list_is_singular(head))
         return;
     // For convenience, i delete head at first
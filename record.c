@@ -0,0 +1,159 @@
+#include "record.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define RECORD_BUFSIZE (1 << 16)
+
+static struct {
+    int fd;
+    char buf[2][RECORD_BUFSIZE];
+    size_t len[2];
+    int active;  /* Buffer being filled */
+    int pending; /* Buffer handed to the writer, -1 if none */
+    bool stop;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} *rec = NULL;
+
+static void write_all(int fd, const char *p, size_t len)
+{
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0)
+            return;
+        p += n;
+        len -= n;
+    }
+}
+
+static void *writer_main(void *arg)
+{
+    pthread_mutex_lock(&rec->lock);
+    while (true) {
+        while (rec->pending < 0 && !rec->stop)
+            pthread_cond_wait(&rec->cond, &rec->lock);
+        if (rec->pending < 0)
+            break;
+
+        int b = rec->pending;
+        pthread_mutex_unlock(&rec->lock);
+        write_all(rec->fd, rec->buf[b], rec->len[b]);
+        pthread_mutex_lock(&rec->lock);
+
+        rec->len[b] = 0;
+        rec->pending = -1;
+        pthread_cond_broadcast(&rec->cond);
+    }
+    pthread_mutex_unlock(&rec->lock);
+    return NULL;
+}
+
+/* Hand the active buffer to the writer and switch to the other one */
+static void submit(void)
+{
+    pthread_mutex_lock(&rec->lock);
+    while (rec->pending >= 0)
+        pthread_cond_wait(&rec->cond, &rec->lock);
+    rec->pending = rec->active;
+    pthread_cond_broadcast(&rec->cond);
+    pthread_mutex_unlock(&rec->lock);
+
+    rec->active ^= 1;
+}
+
+bool record_open(const char *file_name)
+{
+    if (rec)
+        record_close();
+
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    rec = calloc(1, sizeof(*rec));
+    if (!rec) {
+        close(fd);
+        return false;
+    }
+    rec->fd = fd;
+    rec->pending = -1;
+    pthread_mutex_init(&rec->lock, NULL);
+    pthread_cond_init(&rec->cond, NULL);
+
+    /* Leave SIGALRM of the time limit to the thread running commands */
+    sigset_t alarm, mask;
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarm, &mask);
+    int err = pthread_create(&rec->writer, NULL, writer_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+    if (err) {
+        close(fd);
+        free(rec);
+        rec = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+bool record_active(void)
+{
+    return rec != NULL;
+}
+
+void record_printf(const char *fmt, ...)
+{
+    if (!rec)
+        return;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int a = rec->active;
+        size_t room = RECORD_BUFSIZE - rec->len[a];
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(rec->buf[a] + rec->len[a], room, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return;
+
+        if ((size_t) n < room) {
+            rec->len[a] += n;
+            return;
+        }
+        /* Text longer than a whole buffer is truncated */
+        if (rec->len[a] == 0) {
+            rec->len[a] = RECORD_BUFSIZE - 1;
+            return;
+        }
+        submit();
+    }
+}
+
+void record_close(void)
+{
+    if (!rec)
+        return;
+
+    if (rec->len[rec->active])
+        submit();
+
+    pthread_mutex_lock(&rec->lock);
+    rec->stop = true;
+    pthread_cond_broadcast(&rec->cond);
+    pthread_mutex_unlock(&rec->lock);
+    pthread_join(rec->writer, NULL);
+
+    close(rec->fd);
+    pthread_mutex_destroy(&rec->lock);
+    pthread_cond_destroy(&rec->cond);
+    free(rec);
+    rec = NULL;
+}
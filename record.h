@@ -0,0 +1,27 @@
+#ifndef LAB0_RECORD_H
+#define LAB0_RECORD_H
+
+/*
+ * Buffered, asynchronous log writer.
+ *
+ * Text is appended to one of two buffers while a background thread writes
+ * the other one out, so that the caller never waits for the disk unless
+ * both buffers are full.
+ */
+
+#include <stdbool.h>
+
+/* Start logging to file, truncating it.  Return false on failure */
+bool record_open(const char *file_name);
+
+/* Return true if a log is open */
+bool record_active(void);
+
+/* Append formatted text to the log */
+void record_printf(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
+/* Write out pending text and close the log */
+void record_close(void);
+
+#endif /* LAB0_RECORD_H */
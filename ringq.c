@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "ringq.h"
+
+/* Array position of logical position i */
+static inline size_t pos(const ringq_t *q, size_t i)
+{
+    return (q->reversed ? q->head + q->size - 1 - i : q->head + i) & q->mask;
+}
+
+#define slot(q, i) ((q)->items[pos(q, i)])
+
+static char *copy_string(const char *s)
+{
+    size_t len = strlen(s);
+    char *copy = malloc(len + 1);
+    if (copy)
+        memcpy(copy, s, len + 1);
+    return copy;
+}
+
+static void copy_out(const char *s, char *sp, size_t bufsize)
+{
+    if (sp && bufsize) {
+        size_t len = strnlen(s, bufsize - 1);
+        memcpy(sp, s, len);
+        sp[len] = '\0';
+    }
+}
+
+ringq_t *rq_new(void)
+{
+    ringq_t *q = malloc(sizeof(ringq_t));
+    if (!q)
+        return NULL;
+
+    q->items = malloc(RQ_MIN_CAPACITY * sizeof(char *));
+    if (!q->items) {
+        free(q);
+        return NULL;
+    }
+    q->head = q->size = 0;
+    q->mask = RQ_MIN_CAPACITY - 1;
+    q->reversed = false;
+    return q;
+}
+
+void rq_free(ringq_t *q)
+{
+    if (!q)
+        return;
+
+    for (size_t i = 0; i < q->size; i++)
+        free(slot(q, i));
+    free(q->items);
+    free(q);
+}
+
+/* Double the capacity, laying strings out from position 0 in queue order */
+static bool grow(ringq_t *q)
+{
+    size_t capacity = (q->mask + 1) * 2;
+    char **items = malloc(capacity * sizeof(char *));
+    if (!items)
+        return false;
+
+    for (size_t i = 0; i < q->size; i++)
+        items[i] = slot(q, i);
+    free(q->items);
+    q->items = items;
+    q->head = 0;
+    q->mask = capacity - 1;
+    q->reversed = false;
+    return true;
+}
+
+/* Add s before the first string in array order, or after the last one */
+static void push_front(ringq_t *q, char *s)
+{
+    q->head = (q->head - 1) & q->mask;
+    q->items[q->head] = s;
+    q->size++;
+}
+
+static void push_back(ringq_t *q, char *s)
+{
+    q->items[(q->head + q->size) & q->mask] = s;
+    q->size++;
+}
+
+static bool insert(ringq_t *q, const char *s, bool tail)
+{
+    if (!q)
+        return false;
+
+    char *copy = copy_string(s);
+    if (!copy)
+        return false;
+    if (q->size > q->mask && !grow(q)) {
+        free(copy);
+        return false;
+    }
+
+    if (tail != q->reversed)
+        push_back(q, copy);
+    else
+        push_front(q, copy);
+    return true;
+}
+
+bool rq_insert_head(ringq_t *q, const char *s)
+{
+    return insert(q, s, false);
+}
+
+bool rq_insert_tail(ringq_t *q, const char *s)
+{
+    return insert(q, s, true);
+}
+
+static char *remove_at_end(ringq_t *q, bool tail, char *sp, size_t bufsize)
+{
+    if (!q || !q->size)
+        return NULL;
+
+    char *s;
+    if (tail != q->reversed) {
+        s = q->items[(q->head + q->size - 1) & q->mask];
+    } else {
+        s = q->items[q->head];
+        q->head = (q->head + 1) & q->mask;
+    }
+    q->size--;
+
+    copy_out(s, sp, bufsize);
+    return s;
+}
+
+char *rq_remove_head(ringq_t *q, char *sp, size_t bufsize)
+{
+    return remove_at_end(q, false, sp, bufsize);
+}
+
+char *rq_remove_tail(ringq_t *q, char *sp, size_t bufsize)
+{
+    return remove_at_end(q, true, sp, bufsize);
+}
+
+void rq_release(char *s)
+{
+    free(s);
+}
+
+int rq_size(const ringq_t *q)
+{
+    return q ? q->size : 0;
+}
+
+char *rq_at(const ringq_t *q, size_t i)
+{
+    return q && i < q->size ? slot(q, i) : NULL;
+}
+
+bool rq_delete_mid(ringq_t *q)
+{
+    if (!q || !q->size)
+        return false;
+
+    size_t k = q->size / 2;
+    free(slot(q, k));
+
+    /* Close the gap by moving the shorter half, then drop its end */
+    if (k < q->size - 1 - k) {
+        for (size_t i = k; i > 0; i--)
+            slot(q, i) = slot(q, i - 1);
+        remove_at_end(q, false, NULL, 0);
+    } else {
+        for (size_t i = k; i < q->size - 1; i++)
+            slot(q, i) = slot(q, i + 1);
+        remove_at_end(q, true, NULL, 0);
+    }
+    return true;
+}
+
+bool rq_delete_dup(ringq_t *q)
+{
+    if (!q || !q->size)
+        return false;
+
+    /* Distinct strings are compacted toward the logical head */
+    size_t kept = 0;
+    for (size_t i = 0; i < q->size;) {
+        char *s = slot(q, i);
+        size_t j = i + 1;
+        while (j < q->size && !strcmp(slot(q, j), s))
+            free(slot(q, j++));
+        if (j - i > 1)
+            free(s);
+        else
+            slot(q, kept++) = s;
+        i = j;
+    }
+
+    /* Logical positions start from the array end when reversed */
+    if (q->reversed)
+        q->head = (q->head + q->size - kept) & q->mask;
+    q->size = kept;
+    return true;
+}
+
+void rq_swap(ringq_t *q)
+{
+    if (!q)
+        return;
+
+    for (size_t i = 0; i + 1 < q->size; i += 2) {
+        char *tmp = slot(q, i);
+        slot(q, i) = slot(q, i + 1);
+        slot(q, i + 1) = tmp;
+    }
+}
+
+void rq_reverse(ringq_t *q)
+{
+    if (q)
+        q->reversed = !q->reversed;
+}
+
+static void reverse_items(char **items, size_t n)
+{
+    for (size_t i = 0; i < n / 2; i++) {
+        char *tmp = items[i];
+        items[i] = items[n - 1 - i];
+        items[n - 1 - i] = tmp;
+    }
+}
+
+static int compare_string(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+void rq_sort(ringq_t *q)
+{
+    if (!q || q->size < 2)
+        return;
+
+    /* Rotate the whole array so that the strings start at position 0 */
+    if (q->head) {
+        size_t capacity = q->mask + 1;
+        reverse_items(q->items, q->head);
+        reverse_items(q->items + q->head, capacity - q->head);
+        reverse_items(q->items, capacity);
+        q->head = 0;
+    }
+    /* Previous order is irrelevant */
+    q->reversed = false;
+    qsort(q->items, q->size, sizeof(char *), compare_string);
+}
+
+void rq_shuffle(ringq_t *q)
+{
+    if (!q)
+        return;
+
+    /* Fisher-Yates */
+    for (size_t i = q->size; i > 1; i--) {
+        size_t j = rand() % i;
+        char *tmp = slot(q, i - 1);
+        slot(q, i - 1) = slot(q, j);
+        slot(q, j) = tmp;
+    }
+}
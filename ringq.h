@@ -0,0 +1,80 @@
+#ifndef LAB0_RINGQ_H
+#define LAB0_RINGQ_H
+
+/*
+ * Queue of strings stored in a growable ring buffer.
+ *
+ * Pointers to the strings are kept in an array whose capacity is a power of
+ * two, so that positions wrap around with a mask.  Both ends are O(1), the
+ * array doubles when full, and size is kept in a counter.  Reversal flips
+ * the direction in which logical positions map to the array, so it is O(1)
+ * as well.  The operations mirror the q_* functions of queue.h, and memory
+ * is allocated through the harness.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Capacity of a new queue */
+#define RQ_MIN_CAPACITY 16
+
+typedef struct {
+    char **items;
+    /* Array position of the first string in array order */
+    size_t head;
+    size_t size;
+    /* Capacity - 1 */
+    size_t mask;
+    /* Logical order runs from the last string in array order */
+    bool reversed;
+} ringq_t;
+
+/* Create empty queue.  Return NULL if could not allocate space */
+ringq_t *rq_new(void);
+
+/* Free queue and all strings in it */
+void rq_free(ringq_t *q);
+
+/* Insert copy of s at head or tail.  Return false on allocation failure */
+bool rq_insert_head(ringq_t *q, const char *s);
+bool rq_insert_tail(ringq_t *q, const char *s);
+
+/*
+ * Remove string from head or tail, copying up to bufsize - 1 characters of
+ * it to sp if non-NULL.  The returned string is released with rq_release.
+ * Return NULL if queue is NULL or empty.
+ */
+char *rq_remove_head(ringq_t *q, char *sp, size_t bufsize);
+char *rq_remove_tail(ringq_t *q, char *sp, size_t bufsize);
+
+/* Release string returned by a removal */
+void rq_release(char *s);
+
+/* Return number of strings in queue */
+int rq_size(const ringq_t *q);
+
+/* Return string at logical position i, NULL if out of range */
+char *rq_at(const ringq_t *q, size_t i);
+
+/* Delete the string at index size / 2.  Return false if queue is empty */
+bool rq_delete_mid(ringq_t *q);
+
+/*
+ * Delete all strings that occur more than once in sorted queue.
+ * Return false if queue is NULL or empty.
+ */
+bool rq_delete_dup(ringq_t *q);
+
+/* Swap every two adjacent strings */
+void rq_swap(ringq_t *q);
+
+/* Reverse order of strings in O(1) */
+void rq_reverse(ringq_t *q);
+
+/* Sort strings in ascending order, in place in the array */
+void rq_sort(ringq_t *q);
+
+/* Shuffle strings in place */
+void rq_shuffle(ringq_t *q);
+
+#endif /* LAB0_RINGQ_H */
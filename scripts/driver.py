@@ -4,6 +4,12 @@ from __future__ import print_function
 import subprocess
 import sys
 import getopt
+import json
+import os
+import tempfile
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor, wait
 
 
 
@@ -35,7 +41,18 @@ class Tracer:
         14: "trace-14-perf",
         15: "trace-15-perf",
         16: "trace-16-perf",
-        17: "trace-17-complexity"
+        17: "trace-17-complexity",
+        18: "trace-18-scaling",
+        19: "trace-19-pq",
+        20: "trace-20-unrolled",
+        21: "trace-21-ring",
+        22: "trace-22-backend",
+        23: "trace-23-lazyreverse",
+        24: "trace-24-fastremove",
+        25: "trace-25-shm",
+        26: "trace-26-deadline",
+        27: "trace-27-mt",
+        28: "trace-28-steal"
     }
 
     traceProbs = {
@@ -55,10 +72,27 @@ class Tracer:
         14: "Trace-14",
         15: "Trace-15",
         16: "Trace-16",
-        17: "Trace-17"
+        17: "Trace-17",
+        18: "Trace-18",
+        19: "Trace-19",
+        20: "Trace-20",
+        21: "Trace-21",
+        22: "Trace-22",
+        23: "Trace-23",
+        24: "Trace-24",
+        25: "Trace-25",
+        26: "Trace-26",
+        27: "Trace-27",
+        28: "Trace-28"
     }
 
-    maxScores = [0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5]
+    maxScores = [0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5, 5, 6, 6, 6, 6, 6, 6, 6, 5, 6, 6]
+
+    # Traces whose outcome depends on timing
+    perfTraces = {14, 15, 16, 17, 18}
+
+    # Traces passing only if qtest fails with this error
+    expectedErrors = {26: "Time limit exceeded"}
 
     RED = '\033[91m'
     GREEN = '\033[92m'
@@ -69,37 +103,185 @@ class Tracer:
                  verbLevel=0,
                  autograde=False,
                  useValgrind=False,
-                 colored=False):
+                 colored=False,
+                 jobs=1,
+                 serializePerf=False,
+                 summary=False,
+                 jsonFile=None):
         if qtest != "":
             self.qtest = qtest
         self.verbLevel = verbLevel
         self.autograde = autograde
         self.useValgrind = useValgrind
         self.colored = colored
+        self.jobs = max(jobs, 1)
+        self.serializePerf = serializePerf
+        self.summary = summary
+        self.jsonFile = jsonFile
+        self.stats = {}
+        self.cpus = sorted(os.sched_getaffinity(0)) \
+            if hasattr(os, "sched_getaffinity") else []
+        self.freeCpus = list(self.cpus)
+        self.cpuLock = threading.Lock()
+
+    def acquireCpu(self):
+        with self.cpuLock:
+            return self.freeCpus.pop(0) if self.freeCpus else None
+
+    def releaseCpu(self, cpu):
+        if cpu is not None:
+            with self.cpuLock:
+                self.freeCpus.append(cpu)
 
     def printInColor(self, text, color):
         if self.colored == False:
             color = self.WHITE
         print(color, text, self.WHITE, sep = '')
 
-    def runTrace(self, tid):
+    def runTrace(self, tid, pinned=True):
         if not tid in self.traceDict:
             self.printInColor("ERROR: No trace with id %d" % tid, self.RED)
-            return False
+            return False, ""
         fname = "%s/%s.cmd" % (self.traceDirectory, self.traceDict[tid])
-        vname = "%d" % self.verbLevel
+        expected = self.expectedErrors.get(tid)
+        # Errors are only printed from verbosity 1, and must be seen here
+        vname = "%d" % (max(self.verbLevel, 1) if expected else self.verbLevel)
         clist = self.command + ["-v", vname, "-f", fname]
+        # Recording costs a writer thread and file I/O, so only when needed
+        record = None
+        if self.summary or self.jsonFile:
+            record = tempfile.NamedTemporaryFile(suffix=".cmd")
+            clist += ["-r", record.name]
 
+        # Output of concurrent traces is held back and shown in order, and
+        # that of traces expecting an error is searched for it
+        out = tempfile.TemporaryFile() if self.jobs > 1 or expected else None
+        cpu = self.acquireCpu() if self.jobs > 1 and pinned else None
         try:
-            retcode = subprocess.call(clist)
+            start = time.time()
+            proc = subprocess.Popen(clist, stdout=out, stderr=out)
+            # preexec_fn is unsafe in threads, so pin once started
+            if cpu is not None:
+                try:
+                    os.sched_setaffinity(proc.pid, {cpu})
+                except ProcessLookupError:
+                    pass
+            _, status, usage = os.wait4(proc.pid, 0)
+            elapsed = time.time() - start
         except Exception as e:
             self.printInColor("Call of '%s' failed: %s" % (" ".join(clist), e), self.RED)
-            return False
-        return retcode == 0
+            if record:
+                record.close()
+            return False, ""
+        finally:
+            self.releaseCpu(cpu)
+
+        proc.returncode = os.WEXITSTATUS(status) \
+            if os.WIFEXITED(status) else -os.WTERMSIG(status)
+        self.stats[tid] = {
+            "elapsed": elapsed,
+            "user": usage.ru_utime,
+            "sys": usage.ru_stime,
+            "maxrss": usage.ru_maxrss,
+            "commands": self.commandTimes(record) if record else {},
+        }
+        if record:
+            record.close()
+
+        output = ""
+        if out:
+            out.seek(0)
+            output = out.read().decode(errors="replace")
+            out.close()
+        if expected:
+            ok = proc.returncode != 0 and expected in output
+            return ok, output if self.verbLevel > 0 else ""
+        return proc.returncode == 0, output
+
+    @staticmethod
+    def commandTimes(record):
+        """Sum up the per-command times logged by qtest -r, by command."""
+        times = {}
+        name = None
+        for line in record:
+            words = line.decode(errors="replace").split()
+            if not words:
+                continue
+            if not words[0].startswith("##"):
+                name = words[0]
+                continue
+            fields = dict(w.split("=", 1) for w in words[1:] if "=" in w)
+            if name is None or "ns" not in fields:
+                continue
+            ns = int(fields["ns"])
+            entry = times.setdefault(name, {"count": 0, "total_ns": 0,
+                                            "max_ns": 0})
+            entry["count"] += 1
+            entry["total_ns"] += ns
+            entry["max_ns"] = max(entry["max_ns"], ns)
+            name = None
+        return times
+
+    def printSummary(self, scoreDict):
+        print("---\tTrace\t\tPoints\tWall\tUser\tSys\tMax RSS\t"
+              "Slowest command")
+        for t in sorted(self.stats):
+            st = self.stats[t]
+            slowest = ""
+            if st["commands"]:
+                name, entry = max(st["commands"].items(),
+                                  key=lambda kv: kv[1]["max_ns"])
+                slowest = "%s %.3f ms" % (name, entry["max_ns"] / 1e6)
+            print("---\t%s\t%d/%d\t%.2fs\t%.2fs\t%.2fs\t%d KB\t%s" %
+                  (self.traceDict[t], scoreDict[t], self.maxScores[t],
+                   st["elapsed"], st["user"], st["sys"], st["maxrss"],
+                   slowest))
+
+    def writeJson(self, scoreDict):
+        traces = {}
+        for t in sorted(self.stats):
+            st = self.stats[t]
+            traces[self.traceDict[t]] = {
+                "points": scoreDict[t],
+                "max_points": self.maxScores[t],
+                "wall_s": st["elapsed"],
+                "user_s": st["user"],
+                "sys_s": st["sys"],
+                "maxrss_kb": st["maxrss"],
+                "commands": st["commands"],
+            }
+        with open(self.jsonFile, "w") as f:
+            json.dump({"traces": traces}, f, indent=2, sort_keys=True)
+            f.write("\n")
+
+    def runAll(self, tidList):
+        """Run traces, yielding (tid, ok, output) in the order of tidList."""
+        if self.jobs == 1:
+            for t in tidList:
+                if self.verbLevel > 0:
+                    print("+++ TESTING trace %s:" % self.traceDict[t])
+                    sys.stdout.flush()
+                ok, output = self.runTrace(t)
+                yield t, ok, output
+            return
+
+        # Perf traces run alone, once all others are done, when serialized
+        exclusive = [t for t in tidList
+                     if self.serializePerf and t in self.perfTraces]
+        with ThreadPoolExecutor(max_workers=self.jobs) as pool:
+            futures = {t: pool.submit(self.runTrace, t)
+                       for t in tidList if t not in exclusive}
+            for t in tidList:
+                if t in exclusive:
+                    wait(futures.values())
+                    ok, output = self.runTrace(t, pinned=False)
+                else:
+                    ok, output = futures[t].result()
+                yield t, ok, output
 
     def run(self, tid=0):
         scoreDict = {k: 0 for k in self.traceDict.keys()}
-        print("---\tTrace\t\tPoints")
+        print("---\tTrace\t\tPoints\tTime\tMax RSS")
         if tid == 0:
             tidList = self.traceDict.keys()
         else:
@@ -113,17 +295,21 @@ class Tracer:
             self.command = ['valgrind', self.qtest]
         else:
             self.command = [self.qtest]
-        for t in tidList:
+        for t, ok, output in self.runAll(tidList):
             tname = self.traceDict[t]
-            if self.verbLevel > 0:
+            if self.jobs > 1 and self.verbLevel > 0:
                 print("+++ TESTING trace %s:" % tname)
-            ok = self.runTrace(t)
+            print(output, end="")
             maxval = self.maxScores[t]
             tval = maxval if ok else 0
+            line = "---\t%s\t%d/%d" % (tname, tval, maxval)
+            if t in self.stats:
+                line += "\t%.2fs\t%d KB" % (self.stats[t]["elapsed"],
+                                            self.stats[t]["maxrss"])
             if tval < maxval:
-                self.printInColor("---\t%s\t%d/%d" % (tname, tval, maxval), self.RED)
+                self.printInColor(line, self.RED)
             else:
-                self.printInColor("---\t%s\t%d/%d" % (tname, tval, maxval), self.GREEN)
+                self.printInColor(line, self.GREEN)
             score += tval
             maxscore += maxval
             scoreDict[t] = tval
@@ -131,6 +317,10 @@ class Tracer:
             self.printInColor("---\tTOTAL\t\t%d/%d" % (score, maxscore), self.RED)
         else:
             self.printInColor("---\tTOTAL\t\t%d/%d" % (score, maxscore), self.GREEN)
+        if self.summary:
+            self.printSummary(scoreDict)
+        if self.jsonFile:
+            self.writeJson(scoreDict)
         if self.autograde:
             # Generate JSON string
             jstring = '{"scores": {'
@@ -152,6 +342,10 @@ def usage(name):
     print("  -t TID    Trace ID to test")
     print("  -v VLEVEL Set verbosity level (0-3)")
     print("  -c Enable colored text")
+    print("  -j JOBS   Run up to JOBS traces concurrently, each pinned to a CPU")
+    print("  --serialize-perf Run timing sensitive traces alone")
+    print("  -s        Print wall time, CPU time and memory of each trace")
+    print("  --json FILE Write per-trace resource usage and command times")
     sys.exit(0)
 
 
@@ -163,8 +357,13 @@ def run(name, args):
     autograde = False
     useValgrind = False
     colored = False
+    jobs = 1
+    serializePerf = False
+    summary = False
+    jsonFile = None
 
-    optlist, args = getopt.getopt(args, 'hp:t:v:A:c', ['valgrind'])
+    optlist, args = getopt.getopt(args, 'hp:t:v:A:cj:s',
+                                  ['valgrind', 'serialize-perf', 'json='])
     for (opt, val) in optlist:
         if opt == '-h':
             usage(name)
@@ -181,6 +380,14 @@ def run(name, args):
             useValgrind = True
         elif opt == '-c':
             colored = True
+        elif opt == '-j':
+            jobs = int(val)
+        elif opt == '--serialize-perf':
+            serializePerf = True
+        elif opt == '-s':
+            summary = True
+        elif opt == '--json':
+            jsonFile = val
         else:
             print("Unrecognized option '%s'" % opt)
             usage(name)
@@ -190,7 +397,11 @@ def run(name, args):
                verbLevel=vlevel,
                autograde=autograde,
                useValgrind=useValgrind,
-               colored=colored)
+               colored=colored,
+               jobs=jobs,
+               serializePerf=serializePerf,
+               summary=summary,
+               jsonFile=jsonFile)
     t.run(tid)
 
 
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Compile qtest command files (.cmd) into binary traces.
+
+The binary trace is executed by the qtest command 'replay file', which skips
+tokenizing and echoing.  Consecutive identical commands are merged into one
+record with a repeat count.  See console.c for the layout.
+"""
+
+import argparse
+import shutil
+import struct
+import sys
+import tempfile
+
+MAGIC = b"QTRC"
+VERSION = 1
+
+
+def varint(value):
+    """Encode value as unsigned LEB128."""
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+class TraceWriter:
+    """Write a binary trace one command at a time.
+
+    Records are spooled to a temporary file while the string table grows,
+    since the table precedes them in the trace.  Only distinct words are
+    kept in memory, so traces of many millions of commands can be written.
+    """
+
+    def __init__(self, out):
+        self.out = out
+        self.strings = []
+        self.index = {}
+        self.spool = tempfile.TemporaryFile()
+        self.nrecords = 0
+        self.last = None
+        self.repeat = 0
+
+    def intern(self, word):
+        if word not in self.index:
+            self.index[word] = len(self.strings)
+            self.strings.append(word.encode())
+        return self.index[word]
+
+    def flush_record(self):
+        if self.last is not None:
+            self.spool.write(varint(len(self.last)) + varint(self.repeat) +
+                             b"".join(varint(a) for a in self.last))
+            self.nrecords += 1
+        self.last = None
+        self.repeat = 0
+
+    def add(self, words):
+        """Append a command, merging it with an identical predecessor."""
+        args = tuple(self.intern(w) for w in words)
+        if args == self.last and self.repeat < 0xFFFFFFFF:
+            self.repeat += 1
+        else:
+            self.flush_record()
+            self.last = args
+            self.repeat = 1
+
+    def close(self):
+        self.flush_record()
+        self.out.write(MAGIC)
+        self.out.write(struct.pack("<HHII", VERSION, 0, len(self.strings),
+                                   self.nrecords))
+        for data in self.strings:
+            self.out.write(varint(len(data)))
+            self.out.write(data)
+        self.spool.seek(0)
+        shutil.copyfileobj(self.spool, self.out)
+        self.spool.close()
+
+
+def compile_lines(lines, writer):
+    for line in lines:
+        words = line.split()
+        # Annotations written by the record command
+        if words and not words[0].startswith("##"):
+            writer.add(words)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="command file, '-' for stdin")
+    parser.add_argument("-o", "--output", required=True,
+                        help="binary trace to write")
+    args = parser.parse_args()
+
+    try:
+        with open(args.output, "wb") as out:
+            writer = TraceWriter(out)
+            if args.input == "-":
+                compile_lines(sys.stdin, writer)
+            else:
+                with open(args.input) as f:
+                    compile_lines(f, writer)
+            writer.close()
+    except OSError as e:
+        print("tracec: %s" % e, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
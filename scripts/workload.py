@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+"""Generate qtest traces from a parametric workload description.
+
+Operations are drawn from a weighted mix.  The queue is steered toward a
+target size, redrawn from the size distribution every phase, by turning
+inserts into removals from the same end (and back) as needed.  Inserted
+strings follow the length distribution, repeat earlier strings at the
+duplicate rate, and continue an ascending sequence at the sortedness rate.
+
+The queue is simulated alongside, so removals can name the expected string
+(--check) and dedup is always applied to a sorted queue, as q_delete_dup
+requires.
+
+Distributions are written as fixed:N, uniform:LO:HI, normal:MEAN:SD or
+exp:MEAN.  Example, one million operations as text and binary trace:
+
+  scripts/workload.py -n 1e6 --mix ih=4,it=4,rh=3,rt=3,sort=0.01 \\
+      --size uniform:0:5000 -o big.cmd -b big.bin
+"""
+
+import argparse
+import collections
+import os
+import random
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from tracec import TraceWriter  # noqa: E402
+
+OPS = ("ih", "it", "rh", "rt", "sort", "dedup")
+MAX_STRLEN = 255
+LETTERS = "abcdefghijklmnopqrstuvwxyz"
+
+
+def parse_dist(text):
+    """Return a function drawing a non-negative integer from text."""
+    kind, _, args = text.partition(":")
+    try:
+        p = [float(a) for a in args.split(":")] if args else []
+    except ValueError:
+        p = None
+    shapes = {
+        "fixed": (1, lambda r: p[0]),
+        "uniform": (2, lambda r: r.uniform(p[0], p[1])),
+        "normal": (2, lambda r: r.gauss(p[0], p[1])),
+        "exp": (1, lambda r: r.expovariate(1 / p[0]) if p[0] else 0),
+    }
+    if kind not in shapes or p is None or len(p) != shapes[kind][0]:
+        raise argparse.ArgumentTypeError("bad distribution '%s'" % text)
+    draw = shapes[kind][1]
+    return lambda r: max(0, int(round(draw(r))))
+
+
+def parse_mix(text):
+    mix = {}
+    for item in text.split(","):
+        op, _, weight = item.partition("=")
+        if op not in OPS:
+            raise argparse.ArgumentTypeError("unknown operation '%s'" % op)
+        try:
+            mix[op] = float(weight)
+        except ValueError:
+            raise argparse.ArgumentTypeError("bad weight '%s'" % item)
+        if mix[op] < 0:
+            raise argparse.ArgumentTypeError("negative weight '%s'" % item)
+    if not sum(mix.values()):
+        raise argparse.ArgumentTypeError("empty operation mix")
+    return mix
+
+
+def parse_count(text):
+    try:
+        return int(float(text))
+    except ValueError:
+        raise argparse.ArgumentTypeError("bad count '%s'" % text)
+
+
+def parse_rate(text):
+    rate = float(text)
+    if not 0 <= rate <= 1:
+        raise argparse.ArgumentTypeError("rate must be within [0, 1]")
+    return rate
+
+
+class Workload:
+
+    def __init__(self, args):
+        self.args = args
+        self.rand = random.Random(args.seed)
+        self.queue = collections.deque()
+        self.sorted = True
+        self.recent = collections.deque(maxlen=1024)
+        self.sequence = 0
+        self.ops = list(args.mix)
+        self.weights = [args.mix[op] for op in self.ops]
+
+    def random_string(self):
+        length = min(max(self.args.strlen(self.rand), 1), MAX_STRLEN)
+        return "".join(self.rand.choices(LETTERS, k=length))
+
+    def ascending_string(self):
+        """Next value of a sequence that sorts in generation order."""
+        n, digits = self.sequence, []
+        self.sequence += 1
+        for _ in range(7):
+            n, d = divmod(n, 26)
+            digits.append(LETTERS[d])
+        length = min(max(self.args.strlen(self.rand), 7), MAX_STRLEN)
+        return "".join(reversed(digits)).ljust(length, "a")
+
+    def new_string(self):
+        r = self.rand.random()
+        if self.recent and r < self.args.dup:
+            return self.rand.choice(self.recent)
+        if r < self.args.dup + self.args.sorted:
+            s = self.ascending_string()
+        else:
+            s = self.random_string()
+        self.recent.append(s)
+        return s
+
+    def commands(self):
+        """Yield commands as lists of words."""
+        yield ["option", "fail", "0"]
+        yield ["option", "malloc", "0"]
+        yield ["new"]
+
+        target = 0
+        for i in range(self.args.ops):
+            if i % self.args.phase == 0:
+                target = self.args.size(self.rand)
+            op = self.rand.choices(self.ops, self.weights)[0]
+
+            # Steer toward target size, keeping the end of the queue
+            if op in ("ih", "it") and len(self.queue) > target:
+                op = "r" + op[1]
+            elif op in ("rh", "rt") and len(self.queue) < target:
+                op = "i" + op[1]
+            if op in ("rh", "rt") and not self.queue:
+                op = "i" + op[1]
+
+            if op == "ih" or op == "it":
+                s = self.new_string()
+                if op == "ih":
+                    self.queue.appendleft(s)
+                else:
+                    self.queue.append(s)
+                self.sorted = len(self.queue) < 2
+                yield [op, s]
+            elif op == "rh" or op == "rt":
+                s = self.queue.popleft() if op == "rh" else self.queue.pop()
+                yield [op, s] if self.args.check else [op]
+            elif op == "sort":
+                self.queue = collections.deque(sorted(self.queue))
+                self.sorted = True
+                yield ["sort"]
+            elif op == "dedup":
+                if not self.sorted:
+                    self.queue = collections.deque(sorted(self.queue))
+                    self.sorted = True
+                    yield ["sort"]
+                counts = collections.Counter(self.queue)
+                self.queue = collections.deque(
+                    s for s in self.queue if counts[s] == 1)
+                yield ["dedup"]
+
+        yield ["free"]
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__.splitlines()[0],
+        epilog="\n".join(__doc__.splitlines()[2:]),
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-n", "--ops", type=parse_count, default=10000,
+                        help="number of operations (default: 10000)")
+    parser.add_argument("--mix", type=parse_mix,
+                        default=parse_mix("ih=1,it=1,rh=1,rt=1"),
+                        help="weights of %s, as op=w,..." % ", ".join(OPS))
+    parser.add_argument("--size", type=parse_dist,
+                        default=parse_dist("uniform:0:1000"),
+                        help="distribution of target queue size")
+    parser.add_argument("--phase", type=parse_count, default=1000,
+                        help="operations between target size changes")
+    parser.add_argument("--strlen", type=parse_dist,
+                        default=parse_dist("uniform:1:16"),
+                        help="distribution of inserted string length")
+    parser.add_argument("--dup", type=parse_rate, default=0.0,
+                        help="rate of inserts repeating a recent string")
+    parser.add_argument("--sorted", type=parse_rate, default=0.0,
+                        help="rate of inserts continuing ascending sequence")
+    parser.add_argument("--check", action="store_true",
+                        help="make removals verify the expected string")
+    parser.add_argument("--seed", type=int, default=None,
+                        help="seed of random generator")
+    parser.add_argument("-o", "--output", help="command file to write")
+    parser.add_argument("-b", "--binary", help="binary trace to write")
+    args = parser.parse_args()
+
+    if args.dup + args.sorted > 1:
+        parser.error("--dup and --sorted add up to more than 1")
+    if args.phase < 1:
+        parser.error("--phase must be positive")
+    if not args.output and not args.binary:
+        args.output = "-"
+
+    text = binary = writer = None
+    try:
+        if args.output:
+            text = sys.stdout if args.output == "-" else open(args.output, "w")
+        if args.binary:
+            binary = open(args.binary, "wb")
+            writer = TraceWriter(binary)
+
+        for words in Workload(args).commands():
+            if text:
+                text.write(" ".join(words) + "\n")
+            if writer:
+                writer.add(words)
+        if writer:
+            writer.close()
+    except OSError as e:
+        print("workload: %s" % e, file=sys.stderr)
+        return 1
+    finally:
+        if text and text is not sys.stdout:
+            text.close()
+        if binary:
+            binary.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,176 @@
+#include "shmq.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static shmq_slot_t *slot_at(shmq_seg_t *seg, size_t pos)
+{
+    return (shmq_slot_t *) (seg->slots + (pos & seg->mask) * seg->stride);
+}
+
+static shmq_t *map_segment(int fd, size_t size)
+{
+    shmq_t *q = malloc(sizeof(shmq_t));
+    if (!q)
+        return NULL;
+
+    q->seg = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (q->seg == MAP_FAILED) {
+        free(q);
+        return NULL;
+    }
+    q->size = size;
+    return q;
+}
+
+shmq_t *shmq_create(const char *name, size_t capacity, size_t max_len)
+{
+    size_t n = 2;
+    while (n < capacity)
+        n <<= 1;
+    /* Keep slots aligned for their sequence numbers */
+    size_t stride = sizeof(shmq_slot_t) + max_len + 1;
+    stride = (stride + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+    size_t size = sizeof(shmq_seg_t) + n * stride;
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return NULL;
+    shmq_t *q = NULL;
+    if (!ftruncate(fd, size))
+        q = map_segment(fd, size);
+    close(fd);
+    if (!q) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    shmq_seg_t *seg = q->seg;
+    seg->mask = n - 1;
+    seg->stride = stride;
+    seg->max_len = max_len;
+    /* Slot i is free for the producer at position i */
+    for (size_t i = 0; i < n; i++)
+        atomic_init(&slot_at(seg, i)->seq, i);
+    atomic_init(&seg->tail, 0);
+    atomic_init(&seg->head, 0);
+    return q;
+}
+
+/* Check the layout written by shmq_create fits in a segment of size bytes */
+static bool valid_layout(const shmq_seg_t *seg, size_t size)
+{
+    size_t n = seg->mask + 1;
+    if (!n || (n & seg->mask))
+        return false;
+    if (seg->stride < sizeof(shmq_slot_t) + 1 ||
+        seg->stride % sizeof(size_t) ||
+        seg->max_len > seg->stride - sizeof(shmq_slot_t) - 1)
+        return false;
+    return n <= (size - sizeof(shmq_seg_t)) / seg->stride;
+}
+
+shmq_t *shmq_open(const char *name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    shmq_t *q = NULL;
+    if (!fstat(fd, &st) && (size_t) st.st_size >= sizeof(shmq_seg_t))
+        q = map_segment(fd, st.st_size);
+    close(fd);
+
+    /* Any process may have written the segment, so trust no field of it */
+    if (q && !valid_layout(q->seg, q->size)) {
+        shmq_close(q);
+        return NULL;
+    }
+    return q;
+}
+
+void shmq_close(shmq_t *q)
+{
+    if (!q)
+        return;
+    munmap(q->seg, q->size);
+    free(q);
+}
+
+void shmq_unlink(const char *name)
+{
+    shm_unlink(name);
+}
+
+bool shmq_insert_tail(shmq_t *q, const char *s)
+{
+    shmq_seg_t *seg = q->seg;
+    size_t len = strlen(s);
+    if (len > seg->max_len)
+        return false;
+
+    shmq_slot_t *slot;
+    size_t pos = atomic_load_explicit(&seg->tail, memory_order_relaxed);
+    while (true) {
+        slot = slot_at(seg, pos);
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&seg->tail, &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&seg->tail, memory_order_relaxed);
+        }
+    }
+
+    slot->len = len;
+    memcpy(slot->data, s, len + 1);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+const char *shmq_head(shmq_t *q, size_t *len)
+{
+    shmq_seg_t *seg = q->seg;
+    size_t pos = atomic_load_explicit(&seg->head, memory_order_relaxed);
+    shmq_slot_t *slot = slot_at(seg, pos);
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1)
+        return NULL;
+
+    if (len)
+        *len = slot->len;
+    return slot->data;
+}
+
+bool shmq_remove_head(shmq_t *q, char *sp, size_t bufsize)
+{
+    size_t len;
+    const char *s = shmq_head(q, &len);
+    if (!s)
+        return false;
+
+    if (sp && bufsize) {
+        if (len > bufsize - 1)
+            len = bufsize - 1;
+        memcpy(sp, s, len);
+        sp[len] = '\0';
+    }
+
+    /* Free the slot for the producer one lap ahead */
+    shmq_seg_t *seg = q->seg;
+    size_t pos = atomic_load_explicit(&seg->head, memory_order_relaxed);
+    atomic_store_explicit(&slot_at(seg, pos)->seq, pos + seg->mask + 1,
+                          memory_order_release);
+    atomic_store_explicit(&seg->head, pos + 1, memory_order_relaxed);
+    return true;
+}
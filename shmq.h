@@ -0,0 +1,85 @@
+#ifndef LAB0_SHMQ_H
+#define LAB0_SHMQ_H
+
+/*
+ * Queue of strings shared between processes.
+ *
+ * The queue lives in a POSIX shared memory segment, which any process can
+ * map by name.  It is a ring of fixed-size slots, each holding a length
+ * followed by the string.  Producers claim slots at the tail with a
+ * compare-and-swap, as in mpmc.h, so any number of them may insert.  A
+ * single consumer reads strings in place at the head and then releases
+ * their slots, so a string is copied once, by its producer.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHMQ_LINE 64
+
+typedef struct {
+    atomic_size_t seq;
+    uint32_t len;
+    char data[];
+} shmq_slot_t;
+
+/* Layout of the segment */
+typedef struct {
+    size_t mask;   /* Slots - 1 */
+    size_t stride; /* Bytes per slot */
+    size_t max_len;
+    char pad0[SHMQ_LINE - 3 * sizeof(size_t)];
+    atomic_size_t tail; /* Next slot to fill */
+    char pad1[SHMQ_LINE - sizeof(atomic_size_t)];
+    atomic_size_t head; /* Next slot to take */
+    char pad2[SHMQ_LINE - sizeof(atomic_size_t)];
+    char slots[];
+} shmq_seg_t;
+
+/* Mapping of the segment in this process */
+typedef struct {
+    shmq_seg_t *seg;
+    size_t size;
+} shmq_t;
+
+/*
+ * Create segment called name holding capacity strings, rounded up to a
+ * power of two, of up to max_len characters, and map it.
+ * Return NULL if it exists already or could not be created.
+ */
+shmq_t *shmq_create(const char *name, size_t capacity, size_t max_len);
+
+/*
+ * Map existing segment called name.
+ * Return NULL if could not, or if its layout does not fit its size.
+ */
+shmq_t *shmq_open(const char *name);
+
+/* Unmap segment, which lives on until it is unlinked */
+void shmq_close(shmq_t *q);
+
+/* Remove name of segment, which is freed once every process unmapped it */
+void shmq_unlink(const char *name);
+
+/*
+ * Copy s into slot at tail.
+ * Return false if queue is full or s is longer than max_len.
+ */
+bool shmq_insert_tail(shmq_t *q, const char *s);
+
+/*
+ * Consumer only: string at head, read in place, and its length.
+ * It stays valid until removed.  Return NULL if queue is empty.
+ */
+const char *shmq_head(shmq_t *q, size_t *len);
+
+/*
+ * Consumer only: release string at head.
+ * If sp is non-NULL, copy up to bufsize - 1 characters of it to sp first.
+ * Return false if queue is empty.
+ */
+bool shmq_remove_head(shmq_t *q, char *sp, size_t bufsize);
+
+#endif /* LAB0_SHMQ_H */
@@ -0,0 +1,8 @@
+# Test if measured scaling of q_size and q_reverse is linear and that of q_insert_head constant, and that the ring keeps its size in constant time
+option fail 0
+option malloc 0
+complexity size 64000 n
+complexity reverse 64000 n
+complexity ih 64000 1
+option backend ring
+complexity size 64000 1
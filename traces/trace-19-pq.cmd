@@ -0,0 +1,30 @@
+# Test of priority queue push, pop and free, in min and max order
+option fail 0
+option malloc 0
+pq new
+pq push gerbil
+pq push bear
+pq push dolphin
+pq push zebra 20
+pq push aardvark
+pq peek
+pq pop aardvark
+pq pop bear
+pq pop dolphin
+pq pop gerbil
+pq pop zebra
+pq free
+pq new max
+pq push gerbil
+pq push bear
+pq push dolphin
+pq push yak 3
+pq pop yak
+pq pop yak
+pq pop yak
+pq pop gerbil
+pq push zebra
+pq pop zebra
+pq pop dolphin
+pq push cat
+pq free
@@ -0,0 +1,24 @@
+# Test of unrolled list queue across chunk boundaries
+option fail 0
+option malloc 0
+new unrolled
+ih dolphin
+ih bear
+ih gerbil
+size
+dm
+it meerkat 70
+ih vulture 70
+reverse
+rh meerkat
+rt vulture
+swap
+sort
+rh dolphin
+rh gerbil
+rt vulture
+rh meerkat
+it zebra
+dedup
+rh zebra
+free
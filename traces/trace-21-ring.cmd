@@ -0,0 +1,28 @@
+# Test of ring buffer queue across wraparound and growth
+option fail 0
+option malloc 0
+new ring
+it bear 10
+rh bear
+rh bear
+rh bear
+ih dolphin 5
+it gerbil 5
+size
+rh dolphin
+rt gerbil
+reverse
+rh gerbil
+rt dolphin
+ih meerkat
+it vulture
+swap
+sort
+dm
+rh bear
+rt vulture
+rt meerkat
+it zebra
+dedup
+rh zebra
+free
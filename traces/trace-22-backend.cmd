@@ -0,0 +1,55 @@
+# Test of insert_head, insert_tail, remove_head, reverse, size, swap, and sort on each backend chosen with option backend
+option fail 0
+option malloc 0
+option backend ring
+new
+ih dolphin
+ih bear
+ih gerbil
+reverse
+size
+it meerkat
+it bear
+it gerbil
+size
+rh dolphin
+reverse
+size
+sort
+it fish
+swap
+reverse
+rh meerkat
+rh fish
+rh gerbil
+rh gerbil
+rh bear
+rh bear
+size
+free
+option backend unrolled
+new
+ih dolphin
+ih bear
+ih gerbil
+reverse
+size
+it meerkat
+it bear
+it gerbil
+size
+rh dolphin
+reverse
+size
+sort
+it fish
+swap
+reverse
+rh meerkat
+rh fish
+rh gerbil
+rh gerbil
+rh bear
+rh bear
+size
+free
@@ -0,0 +1,31 @@
+# Test of insert_head, insert_tail, remove_head, remove_tail, reverse, swap, and sort with lazy reversal
+option fail 0
+option malloc 0
+option lazyreverse 1
+new
+ih dolphin
+ih bear
+ih gerbil
+it meerkat
+reverse
+rh meerkat
+rt gerbil
+ih cat
+it fish
+swap
+reverse
+rh bear
+rt dolphin
+reverse
+ih ant
+it yak
+reverse
+sort
+rh ant
+rt yak
+reverse
+size
+rh fish
+rh cat
+size
+free
@@ -0,0 +1,30 @@
+# Test of remove_head and remove_tail into a reused buffer with strings shorter and longer than it
+option fail 0
+option malloc 0
+option fastremove 1
+new
+ih aardvark_bear_dolphin_gerbil_jaguar 2
+it ant
+it meerkat_panda_squirrel_vulture_wolf 2
+ih yak
+option length 12
+rh yak
+rh aardvark_bear
+rt meerkat_pand
+option length 3
+rt mee
+rh aar
+option length 40
+rt ant
+it fox
+rt fox
+ih meerkat_panda_squirrel_vulture_wolf
+rh meerkat_panda_squirrel_vulture_wolf
+option length 1
+it gerbil
+rt g
+option length 1024
+ih cat
+rh cat
+size
+free
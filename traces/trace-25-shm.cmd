@@ -0,0 +1,6 @@
+# Test of a queue shared between processes with one or more producers and messages of several lengths
+option fail 0
+option malloc 0
+shm 1 10000
+shm 3 20000 40
+shm 4 2000 4096
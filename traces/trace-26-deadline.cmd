@@ -0,0 +1,6 @@
+# Test of deadline, whose time limit a reverse of a large queue must exceed
+option fail 0
+option malloc 0
+new
+ih RAND 1000000
+deadline 1ms reverse
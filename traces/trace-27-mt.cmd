@@ -0,0 +1,7 @@
+# Test of a lock-free queue shared by threads, which fails if any element is lost or duplicated
+option fail 0
+option malloc 0
+mt 1 1 10000
+mt 4 1 5000
+mt 1 4 5000
+mt 3 3 5000
@@ -0,0 +1,6 @@
+# Test of work stealing on a fork-join task tree, which fails if any task is lost or run twice
+option fail 0
+option malloc 0
+steal 1 0
+steal 4 6
+steal 8 10
@@ -0,0 +1,432 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "unrolled.h"
+
+#define first_chunk(q) list_first_entry(&(q)->chunks, uq_chunk_t, list)
+#define last_chunk(q) list_last_entry(&(q)->chunks, uq_chunk_t, list)
+#define count(c) ((c)->hi - (c)->lo)
+
+/* Allocate chunk whose empty range of slots starts at pos */
+static uq_chunk_t *new_chunk(int pos)
+{
+    uq_chunk_t *c = malloc(sizeof(uq_chunk_t));
+    if (c)
+        c->lo = c->hi = pos;
+    return c;
+}
+
+/* Chunks never stay empty, so that every chunk of a traversal has slots */
+static void drop_if_empty(uq_chunk_t *c)
+{
+    if (c->lo == c->hi) {
+        list_del(&c->list);
+        free(c);
+    }
+}
+
+/*
+ * Move the strings of chunk b, which follows a, to the end of a and free b.
+ * They are placed so that free slots face the nearer end of the queue.
+ */
+static void merge_chunks(unrolled_t *q, uq_chunk_t *a, uq_chunk_t *b)
+{
+    char *items[UQ_CHUNK];
+    int na = count(a), n = na + count(b);
+    memcpy(items, &a->items[a->lo], na * sizeof(char *));
+    memcpy(items + na, &b->items[b->lo], (n - na) * sizeof(char *));
+
+    bool first = a->list.prev == &q->chunks;
+    bool last = b->list.next == &q->chunks;
+    a->lo = first && last ? (UQ_CHUNK - n) / 2 : first ? UQ_CHUNK - n : 0;
+    a->hi = a->lo + n;
+    memcpy(&a->items[a->lo], items, n * sizeof(char *));
+
+    list_del(&b->list);
+    free(b);
+}
+
+/*
+ * Called after a removal from chunk c.  Drop c if empty, or merge it with a
+ * neighbor if both are less than half full, so that removals cannot leave
+ * the strings spread over many nearly empty chunks.
+ */
+static void shrink(unrolled_t *q, uq_chunk_t *c)
+{
+    if (c->lo == c->hi) {
+        drop_if_empty(c);
+        return;
+    }
+    if (count(c) >= UQ_CHUNK / 2)
+        return;
+
+    if (c->list.next != &q->chunks) {
+        uq_chunk_t *next = list_entry(c->list.next, uq_chunk_t, list);
+        if (count(next) < UQ_CHUNK / 2) {
+            merge_chunks(q, c, next);
+            return;
+        }
+    }
+    if (c->list.prev != &q->chunks) {
+        uq_chunk_t *prev = list_entry(c->list.prev, uq_chunk_t, list);
+        if (count(prev) < UQ_CHUNK / 2)
+            merge_chunks(q, prev, c);
+    }
+}
+
+static char *copy_string(const char *s)
+{
+    size_t len = strlen(s);
+    char *copy = malloc(len + 1);
+    if (copy)
+        memcpy(copy, s, len + 1);
+    return copy;
+}
+
+static void copy_out(const char *s, char *sp, size_t bufsize)
+{
+    if (sp && bufsize) {
+        size_t len = strnlen(s, bufsize - 1);
+        memcpy(sp, s, len);
+        sp[len] = '\0';
+    }
+}
+
+/* Return address of next occupied slot of traversal, NULL at the end */
+static char **iter_slot(uq_iter_t *it)
+{
+    while (it->chunk && it->i == it->chunk->hi) {
+        if (it->chunk->list.next == &it->q->chunks) {
+            it->chunk = NULL;
+            break;
+        }
+        it->chunk = list_entry(it->chunk->list.next, uq_chunk_t, list);
+        it->i = it->chunk->lo;
+    }
+    return it->chunk ? (char **) &it->chunk->items[it->i++] : NULL;
+}
+
+void uq_iter_init(const unrolled_t *q, uq_iter_t *it)
+{
+    it->q = q;
+    it->chunk = q && q->size ? first_chunk(q) : NULL;
+    it->i = it->chunk ? it->chunk->lo : 0;
+}
+
+char *uq_iter_next(uq_iter_t *it)
+{
+    char **slot = iter_slot(it);
+    return slot ? *slot : NULL;
+}
+
+unrolled_t *uq_new(void)
+{
+    unrolled_t *q = malloc(sizeof(unrolled_t));
+    if (!q)
+        return NULL;
+
+    INIT_LIST_HEAD(&q->chunks);
+    q->size = 0;
+    return q;
+}
+
+void uq_free(unrolled_t *q)
+{
+    if (!q)
+        return;
+
+    uq_chunk_t *c, *safe;
+    list_for_each_entry_safe (c, safe, &q->chunks, list) {
+        for (int i = c->lo; i < c->hi; i++)
+            free(c->items[i]);
+        free(c);
+    }
+    free(q);
+}
+
+bool uq_insert_head(unrolled_t *q, const char *s)
+{
+    if (!q)
+        return false;
+
+    char *copy = copy_string(s);
+    if (!copy)
+        return false;
+
+    uq_chunk_t *c = q->size ? first_chunk(q) : NULL;
+    if (!c || c->lo == 0) {
+        /* A lone chunk starts in the middle to grow both ways */
+        c = new_chunk(c ? UQ_CHUNK : UQ_CHUNK / 2);
+        if (!c) {
+            free(copy);
+            return false;
+        }
+        list_add(&c->list, &q->chunks);
+    }
+    c->items[--c->lo] = copy;
+    q->size++;
+    return true;
+}
+
+bool uq_insert_tail(unrolled_t *q, const char *s)
+{
+    if (!q)
+        return false;
+
+    char *copy = copy_string(s);
+    if (!copy)
+        return false;
+
+    uq_chunk_t *c = q->size ? last_chunk(q) : NULL;
+    if (!c || c->hi == UQ_CHUNK) {
+        c = new_chunk(c ? 0 : UQ_CHUNK / 2);
+        if (!c) {
+            free(copy);
+            return false;
+        }
+        list_add_tail(&c->list, &q->chunks);
+    }
+    c->items[c->hi++] = copy;
+    q->size++;
+    return true;
+}
+
+char *uq_remove_head(unrolled_t *q, char *sp, size_t bufsize)
+{
+    if (!q || !q->size)
+        return NULL;
+
+    uq_chunk_t *c = first_chunk(q);
+    char *s = c->items[c->lo++];
+    shrink(q, c);
+    q->size--;
+
+    copy_out(s, sp, bufsize);
+    return s;
+}
+
+char *uq_remove_tail(unrolled_t *q, char *sp, size_t bufsize)
+{
+    if (!q || !q->size)
+        return NULL;
+
+    uq_chunk_t *c = last_chunk(q);
+    char *s = c->items[--c->hi];
+    shrink(q, c);
+    q->size--;
+
+    copy_out(s, sp, bufsize);
+    return s;
+}
+
+void uq_release(char *s)
+{
+    free(s);
+}
+
+int uq_size(const unrolled_t *q)
+{
+    return q ? q->size : 0;
+}
+
+char *uq_peek_head(const unrolled_t *q)
+{
+    if (!q || !q->size)
+        return NULL;
+    const uq_chunk_t *c = first_chunk(q);
+    return c->items[c->lo];
+}
+
+char *uq_peek_tail(const unrolled_t *q)
+{
+    if (!q || !q->size)
+        return NULL;
+    const uq_chunk_t *c = last_chunk(q);
+    return c->items[c->hi - 1];
+}
+
+bool uq_delete_mid(unrolled_t *q)
+{
+    if (!q || !q->size)
+        return false;
+
+    /* Skip whole chunks, then index into the one holding the middle */
+    int k = q->size / 2;
+    uq_chunk_t *c;
+    list_for_each_entry (c, &q->chunks, list) {
+        if (k < count(c))
+            break;
+        k -= count(c);
+    }
+
+    int i = c->lo + k;
+    free(c->items[i]);
+    /* Close the gap by shifting the shorter side of the chunk */
+    if (i - c->lo < c->hi - 1 - i) {
+        memmove(&c->items[c->lo + 1], &c->items[c->lo],
+                (i - c->lo) * sizeof(char *));
+        c->lo++;
+    } else {
+        memmove(&c->items[i], &c->items[i + 1],
+                (c->hi - 1 - i) * sizeof(char *));
+        c->hi--;
+    }
+    shrink(q, c);
+    q->size--;
+    return true;
+}
+
+/* Keep the first n strings, which have already been moved into place */
+static void truncate_queue(unrolled_t *q, int n)
+{
+    q->size = n;
+
+    uq_chunk_t *c, *safe;
+    list_for_each_entry_safe (c, safe, &q->chunks, list) {
+        if (n < count(c))
+            c->hi = c->lo + n;
+        n -= count(c);
+        drop_if_empty(c);
+    }
+}
+
+bool uq_delete_dup(unrolled_t *q)
+{
+    if (!q || !q->size)
+        return false;
+
+    /*
+     * Distinct strings are compacted toward the head in one pass.  The
+     * write position never overtakes the read position.
+     */
+    uq_iter_t rd, wr;
+    uq_iter_init(q, &rd);
+    uq_iter_init(q, &wr);
+
+    int kept = 0;
+    char **slot = iter_slot(&rd);
+    while (slot) {
+        char *s = *slot, **next;
+        bool dup = false;
+        while ((next = iter_slot(&rd)) && !strcmp(*next, s)) {
+            free(*next);
+            dup = true;
+        }
+        if (dup) {
+            free(s);
+        } else {
+            *iter_slot(&wr) = s;
+            kept++;
+        }
+        slot = next;
+    }
+    truncate_queue(q, kept);
+    return true;
+}
+
+void uq_swap(unrolled_t *q)
+{
+    uq_iter_t it;
+    uq_iter_init(q, &it);
+
+    char **a, **b;
+    while ((a = iter_slot(&it)) && (b = iter_slot(&it))) {
+        char *tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+}
+
+/* Reverse slots of chunk, mirroring the occupied range as well */
+static void mirror_chunk(uq_chunk_t *c)
+{
+    for (int i = 0; i < UQ_CHUNK / 2; i++) {
+        char *tmp = c->items[i];
+        c->items[i] = c->items[UQ_CHUNK - 1 - i];
+        c->items[UQ_CHUNK - 1 - i] = tmp;
+    }
+    int lo = c->lo;
+    c->lo = UQ_CHUNK - c->hi;
+    c->hi = UQ_CHUNK - lo;
+}
+
+void uq_reverse(unrolled_t *q)
+{
+    if (!q || q->size < 2)
+        return;
+
+    /*
+     * Reverse the chain of chunks, and mirror every chunk so that its free
+     * slots keep facing the nearer end of the queue.
+     */
+    struct list_head *node = &q->chunks;
+    do {
+        struct list_head *next = node->next;
+        node->next = node->prev;
+        node->prev = next;
+        if (node != &q->chunks)
+            mirror_chunk(list_entry(node, uq_chunk_t, list));
+        node = next;
+    } while (node != &q->chunks);
+}
+
+/* Copy the strings in queue order to array a, or back from it */
+static void gather(unrolled_t *q, char **a)
+{
+    uq_iter_t it;
+    uq_iter_init(q, &it);
+    for (char **slot; (slot = iter_slot(&it));)
+        *a++ = *slot;
+}
+
+static void scatter(unrolled_t *q, char **a)
+{
+    uq_iter_t it;
+    uq_iter_init(q, &it);
+    for (char **slot; (slot = iter_slot(&it));)
+        *slot = *a++;
+}
+
+static int compare_string(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+bool uq_sort(unrolled_t *q)
+{
+    if (!q || q->size < 2)
+        return true;
+
+    char **a = malloc(q->size * sizeof(char *));
+    if (!a)
+        return false;
+
+    gather(q, a);
+    qsort(a, q->size, sizeof(char *), compare_string);
+    scatter(q, a);
+    free(a);
+    return true;
+}
+
+bool uq_shuffle(unrolled_t *q)
+{
+    if (!q || q->size < 2)
+        return true;
+
+    char **a = malloc(q->size * sizeof(char *));
+    if (!a)
+        return false;
+
+    /* Fisher-Yates */
+    gather(q, a);
+    for (int i = q->size - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        char *tmp = a[i];
+        a[i] = a[j];
+        a[j] = tmp;
+    }
+    scatter(q, a);
+    free(a);
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef LAB0_UNROLLED_H
+#define LAB0_UNROLLED_H
+
+/*
+ * Queue of strings stored as an unrolled list.
+ *
+ * Pointers to the strings are kept in fixed-capacity chunks, which are
+ * chained in a circular doubly linked list.  A traversal thus loads one
+ * chunk per UQ_CHUNK strings instead of one list node per string.
+ *
+ * The occupied slots of a chunk are contiguous, items[lo] to items[hi - 1],
+ * so the first chunk grows downward and the last one upward, which keeps
+ * insertion and removal at both ends O(1).  The operations mirror the q_*
+ * functions of queue.h, and strings are allocated through the harness.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "list.h"
+
+/* Slots per chunk, so that a chunk takes 512 bytes on LP64 */
+#define UQ_CHUNK 61
+
+typedef struct {
+    struct list_head list;
+    int lo, hi;
+    char *items[UQ_CHUNK];
+} uq_chunk_t;
+
+typedef struct {
+    struct list_head chunks;
+    int size;
+} unrolled_t;
+
+/* Position of a traversal, see uq_iter_next */
+typedef struct {
+    const unrolled_t *q;
+    const uq_chunk_t *chunk;
+    int i;
+} uq_iter_t;
+
+/* Create empty queue.  Return NULL if could not allocate space */
+unrolled_t *uq_new(void);
+
+/* Free queue and all strings in it */
+void uq_free(unrolled_t *q);
+
+/* Insert copy of s at head or tail.  Return false on allocation failure */
+bool uq_insert_head(unrolled_t *q, const char *s);
+bool uq_insert_tail(unrolled_t *q, const char *s);
+
+/*
+ * Remove string from head or tail, copying up to bufsize - 1 characters of
+ * it to sp if non-NULL.  The returned string is released with uq_release.
+ * Return NULL if queue is NULL or empty.
+ */
+char *uq_remove_head(unrolled_t *q, char *sp, size_t bufsize);
+char *uq_remove_tail(unrolled_t *q, char *sp, size_t bufsize);
+
+/* Release string returned by a removal */
+void uq_release(char *s);
+
+/* Return number of strings in queue, in constant time */
+int uq_size(const unrolled_t *q);
+
+/* Return string at head or tail, NULL if queue is NULL or empty */
+char *uq_peek_head(const unrolled_t *q);
+char *uq_peek_tail(const unrolled_t *q);
+
+/* Delete the string at index size / 2.  Return false if queue is empty */
+bool uq_delete_mid(unrolled_t *q);
+
+/*
+ * Delete all strings that occur more than once in sorted queue.
+ * Return false if queue is NULL or empty.
+ */
+bool uq_delete_dup(unrolled_t *q);
+
+/* Swap every two adjacent strings */
+void uq_swap(unrolled_t *q);
+
+/* Reverse order of strings */
+void uq_reverse(unrolled_t *q);
+
+/*
+ * Sort strings in ascending order, or shuffle them.  Both use a scratch
+ * array of one pointer per string.  Return false if it could not be
+ * allocated.
+ */
+bool uq_sort(unrolled_t *q);
+bool uq_shuffle(unrolled_t *q);
+
+/* Start traversal of queue from head */
+void uq_iter_init(const unrolled_t *q, uq_iter_t *it);
+
+/* Return next string of traversal, NULL at the end */
+char *uq_iter_next(uq_iter_t *it);
+
+#endif /* LAB0_UNROLLED_H */
@@ -0,0 +1,120 @@
+#include "wsdeque.h"
+
+#include <stdlib.h>
+
+static ws_array_t *new_array(long size)
+{
+    ws_array_t *a = malloc(sizeof(ws_array_t) + size * sizeof(a->buf[0]));
+    if (a) {
+        a->size = size;
+        a->retired = NULL;
+    }
+    return a;
+}
+
+bool ws_init(wsdeque_t *d, long capacity)
+{
+    long size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    ws_array_t *a = new_array(size);
+    if (!a)
+        return false;
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    atomic_init(&d->array, a);
+    return true;
+}
+
+void ws_destroy(wsdeque_t *d)
+{
+    ws_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    while (a) {
+        ws_array_t *retired = a->retired;
+        free(a);
+        a = retired;
+    }
+    atomic_store_explicit(&d->array, NULL, memory_order_relaxed);
+}
+
+/* Copy elements top to bottom - 1 into an array twice as large */
+static ws_array_t *grow(wsdeque_t *d, ws_array_t *a, long top, long bottom)
+{
+    ws_array_t *b = new_array(a->size * 2);
+    if (!b)
+        return NULL;
+
+    for (long i = top; i < bottom; i++) {
+        element_t *e = atomic_load_explicit(&a->buf[i & (a->size - 1)],
+                                            memory_order_relaxed);
+        atomic_store_explicit(&b->buf[i & (b->size - 1)], e,
+                              memory_order_relaxed);
+    }
+    b->retired = a;
+    atomic_store_explicit(&d->array, b, memory_order_release);
+    return b;
+}
+
+bool ws_push(wsdeque_t *d, element_t *e)
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    ws_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+
+    if (b - t > a->size - 1 && !(a = grow(d, a, t, b)))
+        return false;
+
+    atomic_store_explicit(&a->buf[b & (a->size - 1)], e, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+element_t *ws_pop(wsdeque_t *d)
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    ws_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) {
+        /* Empty */
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    element_t *e =
+        atomic_load_explicit(&a->buf[b & (a->size - 1)], memory_order_relaxed);
+    if (t == b) {
+        /* Last element, which thieves may be taking as well */
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed))
+            e = NULL;
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return e;
+}
+
+ws_steal_t ws_steal(wsdeque_t *d, element_t **e)
+{
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b)
+        return WS_EMPTY;
+
+    /* Acquire pairs with the release store of a grown array */
+    ws_array_t *a = atomic_load_explicit(&d->array, memory_order_acquire);
+    element_t *x =
+        atomic_load_explicit(&a->buf[t & (a->size - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+        return WS_ABORT;
+
+    *e = x;
+    return WS_STOLEN;
+}
@@ -0,0 +1,59 @@
+#ifndef LAB0_WSDEQUE_H
+#define LAB0_WSDEQUE_H
+
+/*
+ * Chase-Lev work-stealing deque of element_t.
+ *
+ * The owner thread pushes and pops at the bottom without atomic
+ * read-modify-write operations, except when taking the last element.
+ * Other threads steal from the top with a compare-and-swap.  The circular
+ * array grows when full.  Arrays it outgrew may still be read by thieves,
+ * so they are only freed by ws_destroy.  Memory orders follow Le, Pop,
+ * Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak
+ * Memory Models", PPoPP 2013.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "queue.h"
+
+#define WS_LINE 64
+
+typedef struct ws_array {
+    long size; /* Power of two */
+    struct ws_array *retired;
+    _Atomic(element_t *) buf[];
+} ws_array_t;
+
+typedef struct {
+    atomic_long top;
+    char pad0[WS_LINE - sizeof(atomic_long)];
+    atomic_long bottom;
+    _Atomic(ws_array_t *) array;
+    char pad1[WS_LINE - sizeof(atomic_long) - sizeof(ws_array_t *)];
+} wsdeque_t;
+
+/* Outcome of ws_steal */
+typedef enum {
+    WS_STOLEN,
+    WS_EMPTY,
+    WS_ABORT, /* Lost a race for the top element */
+} ws_steal_t;
+
+/* Set up empty deque.  Return false if could not allocate space */
+bool ws_init(wsdeque_t *d, long capacity);
+
+/* Release arrays of deque, not the elements left in it */
+void ws_destroy(wsdeque_t *d);
+
+/* Owner only: push e at bottom.  Return false if could not grow */
+bool ws_push(wsdeque_t *d, element_t *e);
+
+/* Owner only: pop element from bottom.  Return NULL if empty */
+element_t *ws_pop(wsdeque_t *d);
+
+/* Any thread: take element from top into *e */
+ws_steal_t ws_steal(wsdeque_t *d, element_t **e);
+
+#endif /* LAB0_WSDEQUE_H */